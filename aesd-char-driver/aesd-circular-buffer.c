@@ -55,6 +55,13 @@ extern void aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffe
  */
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+/**
+ * @brief External declaration for circular buffer initialization on external storage
+ * Implemented in: circular-buffer/src/aesd-circular-buffer-init.c
+ */
+extern void aesd_circular_buffer_init_storage(struct aesd_circular_buffer *buffer, struct aesd_buffer_entry *storage,
+                                              uint32_t capacity);
+
 /**
  * @brief External declaration for circular buffer entry search by offset
  * Implemented in: circular-buffer/src/aesd-circular-buffer-find.c
@@ -16,6 +16,12 @@
  * Features:
  * - Cross-platform compatibility (kernel and userspace)
  * - Structured seek operations with command and offset targeting
+ * - Single-call buffer metadata query
+ * - Consistent bulk snapshot of the stored commands
+ * - Positioned read by command index without moving the file position
+ * - Seek to the first command completed at or after a given time
+ * - Consumer registration for lossless flow control
+ * - Live capacity resize
  * - Standard Linux IOCTL magic number allocation
  * - Bounds checking support for command validation
  *
@@ -68,6 +74,162 @@ struct aesd_seekto
     uint32_t write_cmd_offset;
 };
 
+/**
+ * @brief Structure for the AESDCHAR_IOCGETINFO buffer metadata query
+ *
+ * Describes the device's circular buffer in one call, so clients can plan
+ * their reads without seeking through every command. Commands are numbered
+ * with a per-device sequence starting at 1; when the buffer is empty
+ * newest_seq is oldest_seq - 1.
+ *
+ * Usage example:
+ * uint32_t lengths[16];
+ * struct aesd_info info = {.lengths_len = 16, .lengths_ptr = (uintptr_t)lengths};
+ * ioctl(fd, AESDCHAR_IOCGETINFO, &info);
+ */
+struct aesd_info
+{
+    /** @brief Out: number of commands currently held */
+    uint32_t entry_count;
+
+    /** @brief Out: maximum number of commands the device holds */
+    uint32_t capacity;
+
+    /** @brief Out: sum of the lengths of all held commands, i.e. the SEEK_END position */
+    uint64_t total_bytes;
+
+    /** @brief Out: sequence number of the oldest held command (command index 0) */
+    uint64_t oldest_seq;
+
+    /** @brief Out: sequence number of the newest held command */
+    uint64_t newest_seq;
+
+    /** @brief In: number of uint32_t slots at lengths_ptr, 0 to skip the lengths */
+    uint32_t lengths_len;
+
+    /** @brief Out: number of slots filled, min(lengths_len, entry_count) */
+    uint32_t lengths_filled;
+
+    /** @brief In: user pointer to a uint32_t array receiving each command's length, oldest first */
+    uint64_t lengths_ptr;
+};
+
+/**
+ * @brief Structure for the AESDCHAR_IOCSNAPSHOT bulk copy
+ *
+ * Copies a range of whole commands into one user buffer while the device
+ * lock is held once, so no writer can interleave and the export is a
+ * consistent point-in-time view. Copying stops before the first command
+ * that does not fit in buf_len or in the lengths array; bytes_needed tells
+ * how large buf_len must be to take the whole range in one call.
+ *
+ * Usage example:
+ * char data[4096];
+ * uint32_t lengths[16];
+ * struct aesd_snapshot snap = {.buf_ptr = (uintptr_t)data, .buf_len = sizeof(data),
+ *                              .lengths_ptr = (uintptr_t)lengths, .lengths_len = 16};
+ * ioctl(fd, AESDCHAR_IOCSNAPSHOT, &snap);
+ */
+struct aesd_snapshot
+{
+    /** @brief In: user pointer to the destination buffer */
+    uint64_t buf_ptr;
+
+    /** @brief In: size of the destination buffer in bytes */
+    uint64_t buf_len;
+
+    /** @brief In: user pointer to a uint32_t array receiving each copied command's length, or 0 */
+    uint64_t lengths_ptr;
+
+    /** @brief In: number of slots at lengths_ptr, limits the command count when lengths_ptr is set */
+    uint32_t lengths_len;
+
+    /** @brief In: zero-referenced index of the first command to copy */
+    uint32_t first_cmd;
+
+    /** @brief In: maximum number of commands to copy, 0 for all through the newest */
+    uint32_t max_cmds;
+
+    /** @brief Out: number of whole commands copied */
+    uint32_t cmd_count;
+
+    /** @brief Out: number of bytes written to buf_ptr, the commands back to back */
+    uint64_t bytes_copied;
+
+    /** @brief Out: bytes the full requested range occupies */
+    uint64_t bytes_needed;
+
+    /** @brief Out: sequence number of the first copied command (see struct aesd_info) */
+    uint64_t first_seq;
+};
+
+/**
+ * @brief Structure for the AESDCHAR_IOCPREAD positioned read
+ *
+ * Reads from a command index and offset, as AESDCHAR_IOCSEEKTO followed by
+ * read() calls would, but in one call, under one lock hold and without
+ * moving the file position. Consecutive commands are copied back to back
+ * until buf_len is reached or the newest command ends.
+ *
+ * Usage example:
+ * char data[4096];
+ * struct aesd_pread pr = {.write_cmd = 2, .write_cmd_offset = 10,
+ *                         .buf_ptr = (uintptr_t)data, .buf_len = sizeof(data)};
+ * ioctl(fd, AESDCHAR_IOCPREAD, &pr);
+ */
+struct aesd_pread
+{
+    /** @brief In: zero-referenced index of the command to start in */
+    uint32_t write_cmd;
+
+    /** @brief In: zero-referenced byte offset within that command */
+    uint32_t write_cmd_offset;
+
+    /** @brief In: user pointer to the destination buffer */
+    uint64_t buf_ptr;
+
+    /** @brief In: size of the destination buffer in bytes */
+    uint64_t buf_len;
+
+    /** @brief Out: number of bytes written to buf_ptr */
+    uint64_t bytes_copied;
+
+    /** @brief Out: bytes from the start position to the end of the newest command */
+    uint64_t bytes_available;
+};
+
+/**
+ * @brief Structure for the AESDCHAR_IOCSEEKTIME seek by completion time
+ *
+ * Every command is stamped with CLOCK_REALTIME when its newline arrives;
+ * stamps never decrease, so the first command at or after time_ns is found
+ * by binary search. The file position is set to the start of that command,
+ * or to the end of the data when every command is older.
+ *
+ * Usage example:
+ * struct timespec ts;
+ * clock_gettime(CLOCK_REALTIME, &ts);
+ * struct aesd_seektime st = {.time_ns = (ts.tv_sec - 60) * 1000000000ULL};
+ * ioctl(fd, AESDCHAR_IOCSEEKTIME, &st);   // then read() the last minute
+ */
+struct aesd_seektime
+{
+    /** @brief In: CLOCK_REALTIME time in ns since the epoch */
+    uint64_t time_ns;
+
+    /** @brief Out: command index found, equal to the command count if none */
+    uint32_t write_cmd;
+
+    /** @brief Reserved, must be 0 */
+    uint32_t reserved;
+
+    /** @brief Out: completion time of that command, 0 if none */
+    uint64_t entry_time_ns;
+
+    /** @brief Out: the new file position */
+    uint64_t pos;
+};
+
 /**
  * @brief Magic number for AESD IOCTL commands
  *
@@ -89,6 +251,79 @@ struct aesd_seekto
  */
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
 
+/**
+ * @brief IOCTL command returning buffer metadata and per-command lengths
+ *
+ * Fills a struct aesd_info: entry count, total bytes, oldest and newest
+ * sequence numbers, and up to lengths_len command lengths, all taken from
+ * the same consistent state of the buffer.
+ */
+#define AESDCHAR_IOCGETINFO _IOWR(AESD_IOC_MAGIC, 2, struct aesd_info)
+
+/**
+ * @brief IOCTL command copying a range of commands in one lock hold
+ *
+ * Fills the buffer described by a struct aesd_snapshot with whole commands
+ * and reports their boundaries through the lengths array.
+ */
+#define AESDCHAR_IOCSNAPSHOT _IOWR(AESD_IOC_MAGIC, 3, struct aesd_snapshot)
+
+/**
+ * @brief IOCTL command reading from a command index without seeking
+ *
+ * Combines AESDCHAR_IOCSEEKTO and read() on a struct aesd_pread, leaving
+ * the file position untouched.
+ */
+#define AESDCHAR_IOCPREAD _IOWR(AESD_IOC_MAGIC, 4, struct aesd_pread)
+
+/**
+ * @brief IOCTL command seeking to the first command completed at or after a time
+ *
+ * Takes a struct aesd_seektime; O(log n) in the number of held commands.
+ */
+#define AESDCHAR_IOCSEEKTIME _IOWR(AESD_IOC_MAGIC, 5, struct aesd_seektime)
+
+/**
+ * @brief IOCTL command registering the file as a consumer
+ *
+ * Takes a pointer to a uint32_t: nonzero registers, 0 unregisters. A
+ * consumer reads from its own cursor, which is not shifted when old
+ * commands are dropped. On a device loaded with aesd_lossless=1, writers
+ * wait (or get EAGAIN with O_NONBLOCK) rather than drop a command that a
+ * registered consumer has not read; with no consumer registered, they wait
+ * as soon as the buffer is full.
+ *
+ * Usage example:
+ * uint32_t on = 1;
+ * ioctl(fd, AESDCHAR_IOCCONSUMER, &on);
+ */
+#define AESDCHAR_IOCCONSUMER _IOW(AESD_IOC_MAGIC, 6, uint32_t)
+
+/**
+ * @brief IOCTL command changing the number of commands the device holds
+ *
+ * Takes a pointer to a uint32_t capacity, 1 to AESD_MAX_ENTRIES (EINVAL
+ * otherwise), and requires a file opened for writing and CAP_SYS_ADMIN
+ * (EPERM otherwise), since it affects every user of the device. Held
+ * commands are kept, newest first, so shrinking drops the oldest ones; a
+ * lossless device refuses with EBUSY to drop commands a consumer has not
+ * read. Same as writing /sys/class/aesdchar/aesdcharN/capacity.
+ *
+ * Usage example:
+ * uint32_t capacity = 100;
+ * ioctl(fd, AESDCHAR_IOCRESIZE, &capacity);
+ */
+#define AESDCHAR_IOCRESIZE _IOW(AESD_IOC_MAGIC, 7, uint32_t)
+
+/**
+ * @brief Largest command capacity a device accepts
+ *
+ * Bounds AESDCHAR_IOCRESIZE, the sysfs capacity attribute and the
+ * aesd_max_entries module parameter, and with them the entry arrays the
+ * driver allocates.
+ */
+#define AESD_MAX_ENTRIES 65536
+
 /**
  * @brief Maximum number of IOCTL commands supported
  *
@@ -96,9 +331,10 @@ struct aesd_seekto
  * supported by the AESD character driver. It is used for bounds
  * checking to ensure only valid IOCTL commands are processed.
  *
- * Currently only one command (AESDCHAR_IOCSEEKTO) is supported,
- * but this allows for future expansion of the IOCTL interface.
+ * Supported commands: AESDCHAR_IOCSEEKTO (1), AESDCHAR_IOCGETINFO (2),
+ * AESDCHAR_IOCSNAPSHOT (3), AESDCHAR_IOCPREAD (4), AESDCHAR_IOCSEEKTIME (5),
+ * AESDCHAR_IOCCONSUMER (6), AESDCHAR_IOCRESIZE (7).
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 7
 
 #endif /* AESD_IOCTL_H */
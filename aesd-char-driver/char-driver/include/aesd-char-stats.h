@@ -0,0 +1,147 @@
+/**
+ * @file aesd-char-stats.h
+ * @brief Per-CPU statistics and latency histograms for the AESD character driver
+ *
+ * Every device owns one struct aesd_pcpu_stats per CPU. Hot paths only touch
+ * the local CPU's copy with this_cpu_*() operations, so accounting adds no
+ * shared cache lines or locks. The copies are summed when debugfs is read.
+ *
+ * debugfs layout (one directory per device):
+ * - /sys/kernel/debug/aesdchar/aesdcharN/stats    counters, lock times, buffer state
+ * - /sys/kernel/debug/aesdchar/aesdcharN/latency  log2 latency histograms
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#ifndef AESD_CHAR_STATS_H
+#define AESD_CHAR_STATS_H
+
+#ifdef __KERNEL__
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/types.h>
+
+struct aesd_dev;
+
+/** @brief Number of log2 latency buckets, the last one collects everything above ~1s */
+#define AESD_LAT_BUCKETS 32
+
+/**
+ * @brief Operations with a latency histogram
+ */
+enum aesd_lat_op
+{
+    AESD_LAT_READ,   /**< aesd_read() */
+    AESD_LAT_WRITE,  /**< aesd_write() */
+    AESD_LAT_LLSEEK, /**< aesd_llseek() */
+    AESD_LAT_NR_OPS
+};
+
+/**
+ * @brief Counters kept separately on every CPU
+ */
+struct aesd_pcpu_stats
+{
+    /** @brief Number of completed write() calls */
+    u64 writes;
+
+    /** @brief Number of read() calls that returned data */
+    u64 reads;
+
+    /** @brief Number of ioctl() calls */
+    u64 ioctls;
+
+    /** @brief Total bytes accepted by write() */
+    u64 bytes_written;
+
+    /** @brief Total bytes returned by read() */
+    u64 bytes_read;
+
+    /** @brief Commands dropped to make room for newer ones */
+    u64 evictions;
+
+    /** @brief Writes refused because the pending command would exceed max_pending */
+    u64 pending_rejects;
+
+    /** @brief Lossless-mode writes that had to wait, or got -EAGAIN, for consumers */
+    u64 lossless_waits;
+
+    /** @brief Reads of an LZ4 entry served from the decompression cache */
+    u64 lz4_cache_hits;
+
+    /** @brief Reads of an LZ4 entry that had to decompress it */
+    u64 lz4_cache_misses;
+
+    /** @brief Number of times dev->lock was acquired */
+    u64 lock_acquired;
+
+    /** @brief Total time spent waiting for dev->lock, in ns */
+    u64 lock_wait_ns;
+
+    /** @brief Total time dev->lock was held, in ns */
+    u64 lock_hold_ns;
+
+    /** @brief Latency histograms, bucket b counts calls taking [2^(b-1), 2^b) ns */
+    u64 latency[AESD_LAT_NR_OPS][AESD_LAT_BUCKETS];
+};
+
+/**
+ * @brief Map a duration to its log2 histogram bucket
+ * @param ns Duration in nanoseconds
+ * @return Bucket index, 0 for a zero duration
+ */
+static inline unsigned int aesd_lat_bucket(u64 ns)
+{
+    unsigned int bucket = ns ? ilog2(ns) + 1 : 0;
+
+    return bucket < AESD_LAT_BUCKETS ? bucket : AESD_LAT_BUCKETS - 1;
+}
+
+/**
+ * @brief Allocate the per-CPU counters of a device
+ * @param dev Pointer to the AESD device structure
+ * @return 0 on success, -ENOMEM on failure
+ */
+int aesd_stats_init(struct aesd_dev *dev);
+
+/**
+ * @brief Free the per-CPU counters of a device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_stats_free(struct aesd_dev *dev);
+
+/**
+ * @brief Sum the per-CPU counters of a device into one structure
+ * @param dev Pointer to the AESD device structure
+ * @param sum Output, overwritten with the totals
+ */
+void aesd_stats_sum(struct aesd_dev *dev, struct aesd_pcpu_stats *sum);
+
+/**
+ * @brief Record the latency of one call in the local CPU's histogram
+ * @param dev Pointer to the AESD device structure
+ * @param op Which histogram to update
+ * @param start_ns ktime_get_ns() value taken when the call started
+ */
+void aesd_stats_latency(struct aesd_dev *dev, enum aesd_lat_op op, u64 start_ns);
+
+/**
+ * @brief Create the top-level aesdchar debugfs directory
+ */
+void aesd_debugfs_init(void);
+
+/**
+ * @brief Create the debugfs files of one device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_debugfs_add_device(struct aesd_dev *dev);
+
+/**
+ * @brief Remove the aesdchar debugfs tree and every device's files
+ */
+void aesd_debugfs_exit(void);
+
+#endif /* __KERNEL__ */
+
+#endif /* AESD_CHAR_STATS_H */
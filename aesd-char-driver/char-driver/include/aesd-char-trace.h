@@ -0,0 +1,135 @@
+/**
+ * @file aesd-char-trace.h
+ * @brief Tracepoint definitions for the AESD character driver
+ *
+ * Events appear under /sys/kernel/tracing/events/aesdchar/ and can be used
+ * from perf, trace-cmd or bpftrace, e.g.
+ *   perf record -e 'aesdchar:*' -a
+ *   bpftrace -e 'tracepoint:aesdchar:aesd_write { @[args->minor] = hist(args->lock_wait_ns); }'
+ *
+ * Each trace_*() call compiles to a static-key guarded branch, so events
+ * cost nothing until they are enabled.
+ *
+ * Exactly one translation unit (aesd-char-stats.c) defines
+ * CREATE_TRACE_POINTS before including this header.
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(AESD_CHAR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AESD_CHAR_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+/**
+ * @brief A read() or readv() on a device
+ *
+ * entry is the command index (0 = oldest) the read started in, or -1 at EOF.
+ */
+TRACE_EVENT(aesd_read,
+            TP_PROTO(unsigned int minor, loff_t pos, size_t count, int entry, size_t entry_offset, ssize_t ret,
+                     u64 lock_wait_ns),
+            TP_ARGS(minor, pos, count, entry, entry_offset, ret, lock_wait_ns),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(loff_t, pos) __field(size_t, count)
+                                 __field(int, entry) __field(size_t, entry_offset) __field(ssize_t, ret)
+                                     __field(u64, lock_wait_ns)),
+            TP_fast_assign(__entry->minor = minor; __entry->pos = pos; __entry->count = count;
+                           __entry->entry = entry; __entry->entry_offset = entry_offset; __entry->ret = ret;
+                           __entry->lock_wait_ns = lock_wait_ns;),
+            TP_printk("minor=%u pos=%lld count=%zu entry=%d entry_offset=%zu ret=%zd lock_wait_ns=%llu",
+                      __entry->minor, __entry->pos, __entry->count, __entry->entry, __entry->entry_offset,
+                      __entry->ret, __entry->lock_wait_ns));
+
+/**
+ * @brief A write() or writev() on a device
+ *
+ * pending is the size of the partial command the file has staged afterwards,
+ * 0 when the write completed a command.
+ */
+TRACE_EVENT(aesd_write,
+            TP_PROTO(unsigned int minor, size_t count, size_t pending, ssize_t ret, u64 lock_wait_ns),
+            TP_ARGS(minor, count, pending, ret, lock_wait_ns),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(size_t, count) __field(size_t, pending)
+                                 __field(ssize_t, ret) __field(u64, lock_wait_ns)),
+            TP_fast_assign(__entry->minor = minor; __entry->count = count; __entry->pending = pending;
+                           __entry->ret = ret; __entry->lock_wait_ns = lock_wait_ns;),
+            TP_printk("minor=%u count=%zu pending=%zu ret=%zd lock_wait_ns=%llu", __entry->minor, __entry->count,
+                      __entry->pending, __entry->ret, __entry->lock_wait_ns));
+
+/**
+ * @brief An llseek() on a device, ret is the new position or an error
+ */
+TRACE_EVENT(aesd_llseek,
+            TP_PROTO(unsigned int minor, loff_t offset, int whence, size_t total_size, loff_t ret,
+                     u64 lock_wait_ns),
+            TP_ARGS(minor, offset, whence, total_size, ret, lock_wait_ns),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(loff_t, offset) __field(int, whence)
+                                 __field(size_t, total_size) __field(loff_t, ret) __field(u64, lock_wait_ns)),
+            TP_fast_assign(__entry->minor = minor; __entry->offset = offset; __entry->whence = whence;
+                           __entry->total_size = total_size; __entry->ret = ret;
+                           __entry->lock_wait_ns = lock_wait_ns;),
+            TP_printk("minor=%u offset=%lld whence=%d total_size=%zu ret=%lld lock_wait_ns=%llu", __entry->minor,
+                      __entry->offset, __entry->whence, __entry->total_size, __entry->ret,
+                      __entry->lock_wait_ns));
+
+/**
+ * @brief An ioctl() on a device
+ *
+ * For AESDCHAR_IOCSEEKTO, write_cmd/write_cmd_offset are the requested
+ * position and pos the resulting file position.
+ */
+TRACE_EVENT(aesd_ioctl,
+            TP_PROTO(unsigned int minor, unsigned int cmd, u32 write_cmd, u32 write_cmd_offset, loff_t pos, long ret,
+                     u64 lock_wait_ns),
+            TP_ARGS(minor, cmd, write_cmd, write_cmd_offset, pos, ret, lock_wait_ns),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(unsigned int, cmd) __field(u32, write_cmd)
+                                 __field(u32, write_cmd_offset) __field(loff_t, pos) __field(long, ret)
+                                     __field(u64, lock_wait_ns)),
+            TP_fast_assign(__entry->minor = minor; __entry->cmd = cmd; __entry->write_cmd = write_cmd;
+                           __entry->write_cmd_offset = write_cmd_offset; __entry->pos = pos; __entry->ret = ret;
+                           __entry->lock_wait_ns = lock_wait_ns;),
+            TP_printk("minor=%u cmd=0x%x write_cmd=%u write_cmd_offset=%u pos=%lld ret=%ld lock_wait_ns=%llu",
+                      __entry->minor, __entry->cmd, __entry->write_cmd, __entry->write_cmd_offset, __entry->pos,
+                      __entry->ret, __entry->lock_wait_ns));
+
+/**
+ * @brief A complete command was published into the circular buffer
+ *
+ * slot is the position in the entry array, entries/total_size describe the
+ * buffer after the insert.
+ */
+TRACE_EVENT(aesd_command_complete,
+            TP_PROTO(unsigned int minor, u32 slot, size_t size, u32 entries, size_t total_size),
+            TP_ARGS(minor, slot, size, entries, total_size),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(u32, slot) __field(size_t, size)
+                                 __field(u32, entries) __field(size_t, total_size)),
+            TP_fast_assign(__entry->minor = minor; __entry->slot = slot; __entry->size = size;
+                           __entry->entries = entries; __entry->total_size = total_size;),
+            TP_printk("minor=%u slot=%u size=%zu entries=%u total_size=%zu", __entry->minor, __entry->slot,
+                      __entry->size, __entry->entries, __entry->total_size));
+
+/**
+ * @brief The oldest command was dropped to make room
+ */
+TRACE_EVENT(aesd_evict,
+            TP_PROTO(unsigned int minor, u32 slot, size_t size, size_t total_size),
+            TP_ARGS(minor, slot, size, total_size),
+            TP_STRUCT__entry(__field(unsigned int, minor) __field(u32, slot) __field(size_t, size)
+                                 __field(size_t, total_size)),
+            TP_fast_assign(__entry->minor = minor; __entry->slot = slot; __entry->size = size;
+                           __entry->total_size = total_size;),
+            TP_printk("minor=%u slot=%u size=%zu total_size=%zu", __entry->minor, __entry->slot, __entry->size,
+                      __entry->total_size));
+
+#endif /* AESD_CHAR_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesd-char-trace
+#include <trace/define_trace.h>
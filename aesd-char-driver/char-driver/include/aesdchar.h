@@ -7,10 +7,15 @@
  *
  * The driver provides:
  * - Character device interface for reading/writing data
+ * - Vectored I/O and splice support for zero-copy relay to sockets
  * - Circular buffer management for storing commands
  * - llseek operation support for positioning within data
  * - ioctl support for advanced seek operations
  * - Thread-safe operations using mutex locks
+ * - Multiple independent device instances with per-device limits
+ * - Per-open-file staging of partial commands
+ * - Live capacity resize through sysfs or ioctl
+ * - Per-CPU statistics and latency histograms exported through debugfs
  *
  * @author Dan Walkes (original), Enhanced by Assignment Team
  * @date Created: Oct 23, 2019, Enhanced: June 7, 2025
@@ -22,10 +27,14 @@
 #ifdef __KERNEL__
 #include "../../aesd_ioctl.h"
 #include "../../circular-buffer/include/aesd-circular-buffer.h"
+#include "aesd-char-stats.h"
+#include <linux/atomic.h>
 #include <linux/cdev.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/printk.h>
@@ -33,6 +42,8 @@
 #include <linux/string.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
 
 /**
  * @brief Debug print macro for kernel space logging
@@ -44,38 +55,270 @@
 #define PDEBUG(fmt, ...)
 #endif
 
+/** @brief Number of devices registered when aesd_nr_devs is not given */
+#define AESD_NR_DEVS 1
+
+/** @brief Upper bound for aesd_nr_devs, sizes the per-device parameter arrays */
+#define AESD_MAX_DEVS 16
+
+/** @brief Default limit on a device's pending partial command, in bytes */
+#define AESD_DEFAULT_MAX_PENDING (1024 * 1024)
+
+/** @brief Number of decompressed commands cached per device in LZ4 mode */
+#define AESD_LZ4_CACHE_SLOTS 4
+
+/** @brief Commands shorter than this are stored uncompressed */
+#define AESD_LZ4_MIN_SIZE 64
+
+/**
+ * @brief Driver-side metadata of one entry slot, parallel to aesd_dev::entries
+ */
+struct aesd_entry_meta
+{
+    /** @brief Length of the LZ4 block at buffptr, 0 when the command is stored plain */
+    uint32_t stored_size;
+
+    /** @brief CLOCK_REALTIME ns when the command completed, never below the previous entry's */
+    u64 timestamp_ns;
+
+    /** @brief Offset of the command's first byte in everything ever written to the device */
+    u64 stream_offset;
+};
+
+/**
+ * @brief One decompressed command kept for readers in LZ4 mode
+ */
+struct aesd_lz4_cache_slot
+{
+    /** @brief buffptr of the cached entry, NULL when the slot is free */
+    const char *key;
+
+    /** @brief Decompressed command */
+    char *data;
+
+    /** @brief Allocated size of data */
+    size_t alloc;
+};
+
+/**
+ * @brief Per-device settings, taken from the module parameters
+ */
+struct aesd_dev_params
+{
+    /** @brief Number of commands the device can hold */
+    uint32_t max_entries;
+
+    /** @brief Byte limit for stored commands, 0 for no limit */
+    size_t max_bytes;
+
+    /** @brief Byte limit for a partial command, 0 for no limit */
+    size_t max_pending;
+
+    /** @brief Store completed commands LZ4-compressed */
+    bool compress;
+
+    /** @brief Make writers wait instead of dropping commands consumers have not read */
+    bool lossless;
+};
+
 /**
  * @brief Main device structure for AESD character driver
  *
  * This structure contains all the state information needed for the
  * character driver operation, including the circular buffer for data
  * storage, synchronization primitives, and temporary buffers.
+ * One instance exists per registered minor number.
  */
 struct aesd_dev
 {
     /** @brief Circular buffer for storing complete commands */
     struct aesd_circular_buffer buffer;
 
+    /** @brief Entry storage backing buffer, max_entries slots long */
+    struct aesd_buffer_entry *entries;
+
+    /** @brief Per-slot metadata, indexed like entries */
+    struct aesd_entry_meta *meta;
+
+    /** @brief Index of this device, also its offset from aesd_minor */
+    unsigned int index;
+
+    /** @brief Maximum number of commands held before the oldest is dropped */
+    uint32_t max_entries;
+
+    /** @brief Maximum bytes held before the oldest commands are dropped, 0 for no limit */
+    size_t max_bytes;
+
+    /** @brief Maximum bytes of a partial command staged by one file, 0 for no limit */
+    size_t max_pending;
+
+    /** @brief Bytes allocated for stored commands, below buffer.total_size when compressing */
+    size_t stored_bytes;
+
+    /** @brief Store completed commands LZ4-compressed */
+    bool compress;
+
+    /** @brief Never evict a command before every registered consumer has read it */
+    bool lossless;
+
+    /** @brief Files registered with AESDCHAR_IOCCONSUMER, linked by aesd_file::consumer_node */
+    struct list_head consumers;
+
+    /** @brief Writers waiting for consumers to free space in lossless mode */
+    wait_queue_head_t space_wq;
+
+    /** @brief Bumped under lock whenever space may have been freed, space_wq's condition */
+    u64 space_gen;
+
+    /** @brief Recently decompressed commands */
+    struct aesd_lz4_cache_slot lz4_cache[AESD_LZ4_CACHE_SLOTS];
+
+    /** @brief Next lz4_cache slot to replace */
+    unsigned int lz4_cache_next;
+
+    /** @brief Stream offset the next completed command will start at */
+    u64 stream_end;
+
+    /** @brief Timestamp of the newest completed command, keeps timestamps sorted */
+    u64 last_timestamp_ns;
+
+    /** @brief Sequence number the next completed command will get, starting at 1 */
+    u64 next_seq;
+
+    /** @brief Usage counters and latency histograms, one copy per CPU */
+    struct aesd_pcpu_stats __percpu *stats;
+
+    /** @brief debugfs directory of this device */
+    struct dentry *debugfs_dir;
+
+    /** @brief Class device carrying the sysfs attributes, NULL if not created */
+    struct device *sysfs_dev;
+
+    /** @brief ktime_get_ns() when lock was last acquired, valid while held */
+    u64 lock_acquired_ns;
+
+    /** @brief Time the current lock holder waited for lock, in ns */
+    u64 lock_wait_ns;
+
     /** @brief Mutex for thread-safe access to device state */
     struct mutex lock;
 
     /** @brief Character device structure for kernel interface */
     struct cdev cdev;
 
-    /** @brief Temporary buffer for accumulating partial write data */
+    /** @brief Partial command of a file closed mid-command, continued by the next write */
+    char *orphan_buf;
+
+    /** @brief Current size of data in orphan_buf */
+    size_t orphan_size;
+
+    /** @brief Allocated size of orphan_buf */
+    size_t orphan_alloc;
+
+    /** @brief Bytes staged in all open files and orphan_buf, for debugfs */
+    atomic_long_t pending_bytes;
+
+    /** @brief Bytes allocated for staging in all open files and orphan_buf, for debugfs */
+    atomic_long_t pending_alloc;
+};
+
+/**
+ * @brief Per-open-file state, stored in filp->private_data
+ */
+struct aesd_file
+{
+    /** @brief Device this file was opened on */
+    struct aesd_dev *dev;
+
+    /** @brief Registered as a consumer with AESDCHAR_IOCCONSUMER */
+    bool consumer;
+
+    /** @brief Consumer read cursor as a stream offset, valid while consumer is set */
+    u64 stream_pos;
+
+    /** @brief Link in aesd_dev::consumers */
+    struct list_head consumer_node;
+
+    /** @brief Serializes writers sharing this open file, protects write_buf */
+    struct mutex write_lock;
+
+    /** @brief Partial command staged by this file until its newline arrives */
     char *write_buf;
 
     /** @brief Current size of data in write_buf */
     size_t write_buf_size;
+
+    /** @brief Allocated size of write_buf, grown geometrically */
+    size_t write_buf_alloc;
+
+    /** @brief LZ4 compressor state, LZ4_MEM_COMPRESS bytes, protected by write_lock */
+    void *lz4_wrkmem;
+
+    /** @brief Compression output buffer, sized for the largest command seen */
+    char *lz4_scratch;
+
+    /** @brief Allocated size of lz4_scratch */
+    size_t lz4_scratch_size;
 };
 
+/**
+ * @brief Return the device behind an open file
+ * @param filp Pointer to the file structure
+ * @return The device, or NULL if the file has no private data
+ */
+static inline struct aesd_dev *aesd_file_dev(struct file *filp)
+{
+    struct aesd_file *file = filp->private_data;
+
+    return file ? file->dev : NULL;
+}
+
+/**
+ * @brief Acquire the device lock, accounting the time spent waiting
+ * @param dev Pointer to the AESD device structure
+ * @return 0 on success, -ERESTARTSYS if interrupted by a signal
+ *
+ * Pair with aesd_dev_unlock(), which accounts the hold time.
+ */
+static inline int aesd_dev_lock(struct aesd_dev *dev)
+{
+    u64 start = ktime_get_ns();
+
+    if (mutex_lock_interruptible(&dev->lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    dev->lock_acquired_ns = ktime_get_ns();
+    dev->lock_wait_ns = dev->lock_acquired_ns - start;
+    this_cpu_inc(dev->stats->lock_acquired);
+    this_cpu_add(dev->stats->lock_wait_ns, dev->lock_wait_ns);
+    return 0;
+}
+
+/**
+ * @brief Release the device lock taken by aesd_dev_lock()
+ * @param dev Pointer to the AESD device structure
+ */
+static inline void aesd_dev_unlock(struct aesd_dev *dev)
+{
+    this_cpu_add(dev->stats->lock_hold_ns, ktime_get_ns() - dev->lock_acquired_ns);
+    mutex_unlock(&dev->lock);
+}
+
 /* External variable declarations */
 /** @brief Major device number (dynamically allocated) */
 extern int aesd_major;
 
-/** @brief Minor device number (always 0 for single device) */
+/** @brief First minor device number, device i uses aesd_minor + i */
 extern int aesd_minor;
 
+/** @brief Number of device instances registered */
+extern unsigned int aesd_nr_devs;
+
+/** @brief Array of aesd_nr_devs device instances */
+extern struct aesd_dev *aesd_devices;
+
 /** @brief File operations structure for the character device */
 extern struct file_operations aesd_fops;
 
@@ -117,11 +360,27 @@ ssize_t aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_p
  */
 ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
 
+/**
+ * @brief Vectored read, also the source for splice() and sendfile()
+ * @param iocb Kernel I/O control block holding the file and position
+ * @param to Destination iterator
+ * @return Number of bytes read on success, negative error code on failure
+ */
+ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to);
+
+/**
+ * @brief Vectored write, also the sink for splice() into the device
+ * @param iocb Kernel I/O control block holding the file
+ * @param from Source iterator
+ * @return Number of bytes written on success, negative error code on failure
+ */
+ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from);
+
 /**
  * @brief Seek operation for the AESD character device
  * @param filp Pointer to the file structure
  * @param offset Offset value for seeking
- * @param whence Seek mode (SEEK_SET, SEEK_CUR, SEEK_END)
+ * @param whence Seek mode (SEEK_SET, SEEK_CUR, SEEK_END, SEEK_DATA, SEEK_HOLE)
  * @return New file position on success, negative error code on failure
  */
 loff_t aesd_llseek(struct file *filp, loff_t offset, int whence);
@@ -137,6 +396,15 @@ long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 
 /* Device setup and cleanup function declarations */
 
+/**
+ * @brief Initialize one device instance and allocate its entry storage
+ * @param dev Pointer to the AESD device structure
+ * @param index Device index, selects minor number aesd_minor + index
+ * @param params Capacity, limits and storage mode of the device
+ * @return 0 on success, negative error code on failure
+ */
+int aesd_init_device(struct aesd_dev *dev, unsigned int index, const struct aesd_dev_params *params);
+
 /**
  * @brief Setup character device structure and register with kernel
  * @param dev Pointer to the AESD device structure
@@ -150,25 +418,190 @@ int aesd_setup_cdev(struct aesd_dev *dev);
  */
 void aesd_cleanup_device(struct aesd_dev *dev);
 
-/* Buffer handling function declarations */
+/**
+ * @brief Change the number of commands a device holds, keeping the newest ones
+ * @param dev Pointer to the AESD device structure
+ * @param max_entries New capacity, 1 to AESD_MAX_ENTRIES
+ * @return 0 on success, negative error code on failure
+ */
+int aesd_resize_device(struct aesd_dev *dev, uint32_t max_entries);
+
+/* sysfs function declarations */
+
+/**
+ * @brief Create the aesdchar device class
+ */
+void aesd_sysfs_init(void);
+
+/**
+ * @brief Destroy the aesdchar device class
+ */
+void aesd_sysfs_exit(void);
+
+/**
+ * @brief Create the class device of an instance, with its attributes
+ * @param dev Pointer to the AESD device structure, cdev already added
+ */
+void aesd_sysfs_add_device(struct aesd_dev *dev);
 
 /**
- * @brief Handle incoming write data and buffer management
+ * @brief Remove the class device of an instance
  * @param dev Pointer to the AESD device structure
+ */
+void aesd_sysfs_remove_device(struct aesd_dev *dev);
+
+/* Buffer handling function declarations */
+
+/**
+ * @brief Append write data to a file's staged partial command
+ * @param file Per-file state, with write_lock held
  * @param new_data Pointer to the new data to be buffered
  * @param count Number of bytes in new_data
  * @return 0 on success, negative error code on failure
  */
-int aesd_handle_write_buffer(struct aesd_dev *dev, const char *new_data, size_t count);
+int aesd_handle_write_buffer(struct aesd_file *file, const char *new_data, size_t count);
 
 /**
- * @brief Process a complete command when newline is detected
- * @param dev Pointer to the AESD device structure
+ * @brief Publish a file's staged command into the circular buffer
+ * @param file Per-file state, with write_lock and dev->lock held
+ * @param packed LZ4 block of the command from aesd_compress_command(), or NULL
+ * @param stored_size Length of packed
  *
  * This function is called when a newline character is detected in the
- * write buffer, indicating a complete command. It moves the buffered
- * data from the temporary write buffer to the circular buffer.
+ * staged data, indicating a complete command. It moves the staged data, or
+ * packed in its place, into the circular buffer, evicting the oldest
+ * commands when the entry or byte limit would be exceeded, and leaves the
+ * file with nothing staged.
+ */
+void aesd_handle_complete_command(struct aesd_file *file, char *packed, uint32_t stored_size);
+
+/**
+ * @brief Continue the device's orphaned partial command in a file
+ * @param file Per-file state, with write_lock held and nothing staged
+ * @return 0 on success, -ERESTARTSYS if interrupted waiting for dev->lock
+ */
+int aesd_adopt_orphan(struct aesd_file *file);
+
+/**
+ * @brief Hand a closing file's partial command over to the device
+ * @param file Per-file state of the file being released
+ */
+void aesd_orphan_partial(struct aesd_file *file);
+
+/**
+ * @brief Free a file's staged partial command
+ * @param file Per-file state
+ */
+void aesd_free_write_buffer(struct aesd_file *file);
+
+/**
+ * @brief Stream offset every registered consumer has read up to
+ * @param dev Pointer to the AESD device structure
+ * @return The slowest consumer's cursor, 0 when no consumer is registered
+ */
+u64 aesd_lossless_consumed(struct aesd_dev *dev);
+
+/**
+ * @brief Check whether a command can be published without losing unread data
+ * @param dev Pointer to the AESD device structure
+ * @param size Upper bound of the command's stored size
+ * @return true if lossless mode is off or only consumed commands would be evicted
+ */
+bool aesd_lossless_has_room(struct aesd_dev *dev, size_t size);
+
+/**
+ * @brief Wake writers waiting in lossless mode after space may have been freed
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_lossless_wake(struct aesd_dev *dev);
+
+/* Compression function declarations */
+
+/**
+ * @brief Return the metadata slot belonging to a buffer entry
+ * @param dev Pointer to the AESD device structure
+ * @param entry Entry inside dev->buffer
+ * @return Matching element of dev->meta
+ */
+static inline struct aesd_entry_meta *aesd_entry_meta(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    return &dev->meta[entry - dev->buffer.entry];
+}
+
+/**
+ * @brief Bytes an entry occupies in memory
+ * @param dev Pointer to the AESD device structure
+ * @param entry Entry inside dev->buffer
+ * @return Compressed length for LZ4 entries, the command length otherwise
+ */
+static inline size_t aesd_entry_stored_size(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    uint32_t stored = aesd_entry_meta(dev, entry)->stored_size;
+
+    return stored ? stored : entry->size;
+}
+
+/**
+ * @brief Stream offset of the oldest held byte
+ * @param dev Pointer to the AESD device structure
+ * @return Stream offset of the oldest command, or stream_end when empty
+ */
+static inline u64 aesd_stream_base(struct aesd_dev *dev)
+{
+    if (!aesd_circular_buffer_count(&dev->buffer))
+    {
+        return dev->stream_end;
+    }
+    return aesd_entry_meta(dev, &dev->buffer.entry[dev->buffer.out_offs])->stream_offset;
+}
+
+/**
+ * @brief File position of an entry, i.e. its offset from the oldest held command
+ * @param dev Pointer to the AESD device structure, with a non-empty buffer
+ * @param entry Entry inside dev->buffer
+ * @return Sum of the sizes of the entries before it, computed in O(1)
+ */
+static inline loff_t aesd_entry_pos(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    return aesd_entry_meta(dev, entry)->stream_offset - aesd_stream_base(dev);
+}
+
+/**
+ * @brief Free the decompression cache of a device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_compress_free(struct aesd_dev *dev);
+
+/**
+ * @brief Free the LZ4 state of a file
+ * @param file Per-file state, no longer used for writing
+ */
+void aesd_compress_file_free(struct aesd_file *file);
+
+/**
+ * @brief Compress a completed command, before dev->lock is taken
+ * @param file Per-file state, with write_lock held
+ * @param data Command bytes
+ * @param size Command length
+ * @param stored_size Output, length of the returned block
+ * @return Newly allocated LZ4 block, or NULL to store the command plain
+ */
+char *aesd_compress_command(struct aesd_file *file, const char *data, size_t size, uint32_t *stored_size);
+
+/**
+ * @brief Return the plain bytes of an entry, decompressing through the cache
+ * @param dev Pointer to the AESD device structure
+ * @param entry Entry inside dev->buffer
+ * @return Pointer to entry->size bytes valid until dev->lock is released,
+ *         NULL if the entry could not be decompressed
+ */
+const char *aesd_entry_data(struct aesd_dev *dev, const struct aesd_buffer_entry *entry);
+
+/**
+ * @brief Drop an entry from the decompression cache before it is freed
+ * @param dev Pointer to the AESD device structure
+ * @param buffptr buffptr of the entry being freed
  */
-void aesd_handle_complete_command(struct aesd_dev *dev);
+void aesd_compress_forget(struct aesd_dev *dev, const char *buffptr);
 
 #endif /* AESD_CHAR_DRIVER_H */
@@ -4,8 +4,10 @@
  *
  * This file implements the buffer management functionality for the AESD
  * character driver, including:
- * - Temporary write buffer handling for partial commands
+ * - Per-file staging of partial commands, and the orphan left by a file
+ *   closed mid-command
  * - Complete command processing and circular buffer integration
+ * - The lossless-mode check that keeps unread commands from being evicted
  * - Memory management for dynamic buffer allocation
  *
  * @author Assignment Team
@@ -13,119 +15,405 @@
  */
 
 #define __KERNEL__
+#include "../include/aesd-char-trace.h"
 #include "../include/aesdchar.h"
+#include <linux/atomic.h>
 #include <linux/errno.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/wait.h>
 
 /**
- * @brief Handle incoming write data and manage temporary buffer
+ * @brief Track a change of the bytes staged for a device
  * @param dev Pointer to the AESD device structure
+ * @param size Change of the staged bytes
+ * @param alloc Change of the bytes allocated for staging
+ */
+static void aesd_pending_account(struct aesd_dev *dev, long size, long alloc)
+{
+    atomic_long_add(size, &dev->pending_bytes);
+    atomic_long_add(alloc, &dev->pending_alloc);
+}
+
+/**
+ * @brief Handle incoming write data and manage the file's staging buffer
+ * @param file Per-file state, with write_lock held
  * @param new_data Pointer to new data to be buffered
  * @param count Number of bytes in new_data
- * @return 0 on success, negative error code on failure
+ * @return 0 on success, -ENOSPC if the pending command would exceed
+ *         dev->max_pending, other negative error code on failure
  *
- * This function manages the temporary write buffer that accumulates data
+ * This function manages the staging buffer that accumulates a file's data
  * until a complete command (terminated by newline) is received. It:
- * 1. Appends new data to existing buffer or creates new buffer
- * 2. Handles memory reallocation as needed
+ * 1. Refuses data that would grow the pending command past max_pending
+ * 2. Appends new data to existing buffer or creates new buffer
  * 3. Ensures null termination for string operations
  *
- * The temporary buffer allows the driver to handle partial writes and
- * reconstruct complete commands before adding them to the circular buffer.
+ * The first write of a command is allocated exactly; appends grow the
+ * allocation geometrically (capped at max_pending), so a command built from
+ * many small writes is copied O(log n) times instead of once per write.
+ * On failure the pending command is left untouched.
+ *
+ * Each open file stages its own command, so dev->lock is not needed here.
  */
-int aesd_handle_write_buffer(struct aesd_dev *dev, const char *new_data, size_t count)
+int aesd_handle_write_buffer(struct aesd_file *file, const char *new_data, size_t count)
 {
+    struct aesd_dev *dev;
     char *new_buf = NULL;
     size_t new_size = 0;
+    size_t new_alloc = 0;
 
     /* Input validation */
-    if (!dev || !new_data)
+    if (!file || !new_data)
     {
         return -EINVAL;
     }
+    dev = file->dev;
+
+    new_size = file->write_buf_size + count;
+    if (dev->max_pending && new_size > dev->max_pending)
+    {
+        this_cpu_inc(dev->stats->pending_rejects);
+        return -ENOSPC;
+    }
 
-    /* Append to existing buffer or create new buffer */
-    if (dev->write_buf)
+    /* Grow the buffer when the new data and the terminator do not fit */
+    if (new_size + 1 > file->write_buf_alloc)
     {
-        /* Existing buffer - reallocate to accommodate new data */
-        new_size = dev->write_buf_size + count;
-        new_buf = krealloc(dev->write_buf, new_size + 1, GFP_KERNEL);
+        new_alloc = new_size + 1;
+        if (file->write_buf)
+        {
+            new_alloc = max(new_alloc, file->write_buf_alloc * 2);
+            if (dev->max_pending)
+            {
+                new_alloc = min(new_alloc, dev->max_pending + 1);
+            }
+        }
+
+        /* krealloc() of NULL is a plain allocation */
+        new_buf = krealloc(file->write_buf, new_alloc, GFP_KERNEL);
         if (!new_buf)
         {
             return -ENOMEM;
         }
+        aesd_pending_account(dev, 0, (long)new_alloc - (long)file->write_buf_alloc);
+        file->write_buf = new_buf;
+        file->write_buf_alloc = new_alloc;
+    }
+
+    /* Append new data to the pending command */
+    memcpy(file->write_buf + file->write_buf_size, new_data, count);
+    file->write_buf_size = new_size;
+    aesd_pending_account(dev, count, 0);
 
-        /* Append new data to existing buffer */
-        memcpy(new_buf + dev->write_buf_size, new_data, count);
-        dev->write_buf = new_buf;
-        dev->write_buf_size = new_size;
+    /* Ensure null termination for safe string operations */
+    file->write_buf[file->write_buf_size] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Free a file's staged partial command
+ * @param file Per-file state
+ */
+void aesd_free_write_buffer(struct aesd_file *file)
+{
+    aesd_pending_account(file->dev, -(long)file->write_buf_size, -(long)file->write_buf_alloc);
+    kfree(file->write_buf);
+    file->write_buf = NULL;
+    file->write_buf_size = 0;
+    file->write_buf_alloc = 0;
+}
+
+/**
+ * @brief Continue the device's orphaned partial command in a file
+ * @param file Per-file state, with write_lock held and nothing staged
+ * @return 0 on success, -ERESTARTSYS if interrupted waiting for dev->lock
+ *
+ * Keeps the behaviour of the former device-wide write buffer, where
+ * "echo -n" into the device followed by another write produced one
+ * command: the next file to write takes over what a closed file left.
+ * The unlocked peek keeps the common case free of dev->lock.
+ */
+int aesd_adopt_orphan(struct aesd_file *file)
+{
+    struct aesd_dev *dev = file->dev;
+
+    if (!READ_ONCE(dev->orphan_buf) || file->write_buf_size)
+    {
+        return 0;
     }
-    else
+
+    if (aesd_dev_lock(dev))
     {
-        /* No existing buffer - create new one */
-        dev->write_buf = kmalloc(count + 1, GFP_KERNEL);
-        if (!dev->write_buf)
-        {
-            return -ENOMEM;
-        }
+        return -ERESTARTSYS;
+    }
 
-        /* Copy data to new buffer */
-        memcpy(dev->write_buf, new_data, count);
-        dev->write_buf_size = count;
+    if (dev->orphan_buf)
+    {
+        aesd_pending_account(dev, 0, -(long)file->write_buf_alloc);
+        kfree(file->write_buf);
+        file->write_buf = dev->orphan_buf;
+        file->write_buf_size = dev->orphan_size;
+        file->write_buf_alloc = dev->orphan_alloc;
+        WRITE_ONCE(dev->orphan_buf, NULL);
+        dev->orphan_size = 0;
+        dev->orphan_alloc = 0;
     }
 
-    /* Ensure null termination for safe string operations */
-    dev->write_buf[dev->write_buf_size] = '\0';
+    aesd_dev_unlock(dev);
     return 0;
 }
 
 /**
- * @brief Process a complete command and add it to the circular buffer
+ * @brief Hand a closing file's partial command over to the device
+ * @param file Per-file state of the file being released
+ *
+ * Appended to an existing orphan when two files close mid-command; data
+ * that would push the orphan past max_pending is dropped and counted as a
+ * pending reject. Takes dev->lock uninterruptibly since release cannot fail.
+ */
+void aesd_orphan_partial(struct aesd_file *file)
+{
+    struct aesd_dev *dev = file->dev;
+    size_t new_size;
+    char *new_buf;
+
+    if (!file->write_buf_size)
+    {
+        aesd_free_write_buffer(file);
+        return;
+    }
+
+    mutex_lock(&dev->lock);
+    if (!dev->orphan_buf)
+    {
+        WRITE_ONCE(dev->orphan_buf, file->write_buf);
+        dev->orphan_size = file->write_buf_size;
+        dev->orphan_alloc = file->write_buf_alloc;
+        file->write_buf = NULL;
+        file->write_buf_size = 0;
+        file->write_buf_alloc = 0;
+        goto out;
+    }
+
+    new_size = dev->orphan_size + file->write_buf_size;
+    if (dev->max_pending && new_size > dev->max_pending)
+    {
+        this_cpu_inc(dev->stats->pending_rejects);
+        goto out;
+    }
+
+    if (new_size + 1 > dev->orphan_alloc)
+    {
+        new_buf = krealloc(dev->orphan_buf, new_size + 1, GFP_KERNEL);
+        if (!new_buf)
+        {
+            goto out;
+        }
+        aesd_pending_account(dev, 0, (long)(new_size + 1) - (long)dev->orphan_alloc);
+        WRITE_ONCE(dev->orphan_buf, new_buf);
+        dev->orphan_alloc = new_size + 1;
+    }
+    memcpy(dev->orphan_buf + dev->orphan_size, file->write_buf, file->write_buf_size);
+    aesd_pending_account(dev, file->write_buf_size, 0);
+    dev->orphan_size = new_size;
+    dev->orphan_buf[new_size] = '\0';
+
+out:
+    mutex_unlock(&dev->lock);
+    aesd_free_write_buffer(file);
+}
+
+/**
+ * @brief Drop the oldest command from the circular buffer and free it
  * @param dev Pointer to the AESD device structure
  *
+ * Must be called with dev->lock held and a non-empty buffer.
+ */
+static void aesd_evict_oldest(struct aesd_dev *dev)
+{
+    struct aesd_buffer_entry *oldest = &dev->buffer.entry[dev->buffer.out_offs];
+
+    struct aesd_entry_meta *meta = aesd_entry_meta(dev, oldest);
+
+    trace_aesd_evict(MINOR(dev->cdev.dev), dev->buffer.out_offs, oldest->size, dev->buffer.total_size);
+    dev->stored_bytes -= aesd_entry_stored_size(dev, oldest);
+    if (meta->stored_size)
+    {
+        aesd_compress_forget(dev, oldest->buffptr);
+        meta->stored_size = 0;
+    }
+    kfree((void *)oldest->buffptr);
+    aesd_circular_buffer_remove_entry(&dev->buffer);
+    this_cpu_inc(dev->stats->evictions);
+}
+
+/**
+ * @brief Process a complete command and add it to the circular buffer
+ * @param file Per-file state, with write_lock and dev->lock held
+ * @param packed LZ4 block of the command from aesd_compress_command(), or NULL
+ *               to store the staged bytes plain
+ * @param stored_size Length of packed
+ *
  * This function is called when a complete command (terminated by newline)
- * has been accumulated in the write buffer. It:
- * 1. Creates a buffer entry from the accumulated data
- * 2. Handles buffer overflow by freeing the oldest entry if necessary
- * 3. Adds the new entry to the circular buffer
- * 4. Resets the write buffer for the next command
+ * has been accumulated in the file's staging buffer. It:
+ * 1. Creates a buffer entry from the accumulated data, or from packed when
+ *    the writer compressed it before taking dev->lock
+ * 2. Frees the oldest entries while the buffer is full or the device's
+ *    byte limit would be exceeded
+ * 3. Adds the new entry to the circular buffer, recording its completion
+ *    time and stream offset
+ * 4. Resets the file's staging buffer for the next command
  *
- * The function ensures that when the circular buffer is full, the oldest
- * entry is properly freed before being overwritten by the new entry.
+ * max_bytes limits the memory held (dev->stored_bytes), so in LZ4 mode it
+ * admits more history than its value. A single command larger than
+ * max_bytes is still stored, on its own.
  */
-void aesd_handle_complete_command(struct aesd_dev *dev)
+void aesd_handle_complete_command(struct aesd_file *file, char *packed, uint32_t stored_size)
 {
+    struct aesd_dev *dev = file ? file->dev : NULL;
     struct aesd_buffer_entry entry = {0};
-    struct aesd_buffer_entry *oldest = NULL;
+    u64 now = ktime_get_real_ns();
+    size_t footprint;
+    uint32_t slot;
 
-    if (!dev || !dev->write_buf)
+    if (!dev || !file->write_buf)
     {
+        kfree(packed);
         return;
     }
 
-    /* Copy the completed command */
-    entry.buffptr = dev->write_buf;
-    entry.size = dev->write_buf_size;
+    /* Take over the staged command, or its LZ4 block in its place */
+    entry.size = file->write_buf_size;
+    if (packed)
+    {
+        kfree(file->write_buf);
+        entry.buffptr = packed;
+        footprint = stored_size;
+    }
+    else
+    {
+        stored_size = 0;
+        entry.buffptr = file->write_buf;
+        footprint = entry.size;
+    }
 
-    /* If buffer is full, free the oldest entry */
+    /* Make room: one free slot, and enough bytes when a limit is set */
     if (dev->buffer.full)
     {
-        oldest = &dev->buffer.entry[dev->buffer.out_offs];
-        if (oldest->buffptr)
-        {
-            kfree((void *)oldest->buffptr);
-            oldest->buffptr = NULL;
-            oldest->size = 0;
-        }
+        aesd_evict_oldest(dev);
+    }
+    while (dev->max_bytes && aesd_circular_buffer_count(&dev->buffer) &&
+           dev->stored_bytes + footprint > dev->max_bytes)
+    {
+        aesd_evict_oldest(dev);
     }
 
-    /* Reset write buffer pointers */
-    dev->write_buf = NULL;
-    dev->write_buf_size = 0;
+    /* The entry owns the staged bytes now */
+    aesd_pending_account(dev, -(long)file->write_buf_size, -(long)file->write_buf_alloc);
+    file->write_buf = NULL;
+    file->write_buf_size = 0;
+    file->write_buf_alloc = 0;
 
     /* Add new entry to circular buffer */
+    slot = dev->buffer.in_offs;
+    dev->meta[slot].stored_size = stored_size;
+    dev->meta[slot].timestamp_ns = max(now, dev->last_timestamp_ns);
+    dev->meta[slot].stream_offset = dev->stream_end;
+    dev->last_timestamp_ns = dev->meta[slot].timestamp_ns;
+    dev->stream_end += entry.size;
+    dev->stored_bytes += footprint;
     aesd_circular_buffer_add_entry(&dev->buffer, &entry);
+    dev->next_seq++;
+    trace_aesd_command_complete(MINOR(dev->cdev.dev), slot, entry.size, aesd_circular_buffer_count(&dev->buffer),
+                                dev->buffer.total_size);
+}
+
+/**
+ * @brief Stream offset every registered consumer has read up to
+ * @param dev Pointer to the AESD device structure
+ * @return The slowest consumer's cursor, 0 when no consumer is registered
+ *
+ * With no consumer registered nothing counts as read. Must be called with
+ * dev->lock held.
+ */
+u64 aesd_lossless_consumed(struct aesd_dev *dev)
+{
+    struct aesd_file *file;
+    u64 consumed = U64_MAX;
+
+    if (list_empty(&dev->consumers))
+    {
+        return 0;
+    }
+    list_for_each_entry(file, &dev->consumers, consumer_node)
+    {
+        consumed = min(consumed, file->stream_pos);
+    }
+    return consumed;
+}
+
+/**
+ * @brief Check whether a command can be published without losing unread data
+ * @param dev Pointer to the AESD device structure
+ * @param size Upper bound of the command's stored size
+ * @return true if lossless mode is off or only consumed commands would be evicted
+ *
+ * Replays the eviction rule of aesd_handle_complete_command() and checks
+ * that every command it would drop ends at or before the slowest registered
+ * consumer's cursor (see aesd_lossless_consumed()), so with no consumer
+ * registered writers wait as soon as an eviction would be needed.
+ *
+ * Must be called with dev->lock held.
+ */
+bool aesd_lossless_has_room(struct aesd_dev *dev, size_t size)
+{
+    uint32_t count = aesd_circular_buffer_count(&dev->buffer);
+    size_t stored = dev->stored_bytes;
+    uint32_t evicted = 0;
+    u64 consumed;
+
+    if (!dev->lossless)
+    {
+        return true;
+    }
+
+    consumed = aesd_lossless_consumed(dev);
+
+    while ((dev->buffer.full && !evicted) || (dev->max_bytes && evicted < count && stored + size > dev->max_bytes))
+    {
+        struct aesd_buffer_entry *oldest = aesd_circular_buffer_entry_at(&dev->buffer, evicted);
+
+        if (aesd_entry_meta(dev, oldest)->stream_offset + oldest->size > consumed)
+        {
+            return false;
+        }
+        stored -= aesd_entry_stored_size(dev, oldest);
+        evicted++;
+    }
+    return true;
+}
+
+/**
+ * @brief Wake writers waiting in lossless mode after space may have been freed
+ * @param dev Pointer to the AESD device structure
+ *
+ * Must be called with dev->lock held. Waiters sleep on a change of
+ * space_gen rather than on aesd_lossless_has_room() itself, since the
+ * consumer list can only be walked under the lock.
+ */
+void aesd_lossless_wake(struct aesd_dev *dev)
+{
+    if (!dev->lossless)
+    {
+        return;
+    }
+
+    WRITE_ONCE(dev->space_gen, dev->space_gen + 1);
+    wake_up_interruptible(&dev->space_wq);
 }
@@ -0,0 +1,205 @@
+/**
+ * @file aesd-char-compress.c
+ * @brief Optional LZ4 compression of stored commands for AESD character driver
+ *
+ * With the aesd_lz4 module parameter set, every completed command of at
+ * least AESD_LZ4_MIN_SIZE bytes is compressed with the kernel LZ4 library
+ * before it is published, and kept plain only when LZ4 does not shrink it.
+ * dev->meta records which entries are compressed.
+ *
+ * Compression runs in the writer before dev->lock is taken, with the LZ4
+ * state of the writing file, so a large command never holds up readers
+ * or writers on other files.
+ *
+ * Readers get plain bytes through aesd_entry_data(), which decompresses into
+ * a small per-device cache keyed by buffptr so that a sequential reader
+ * walking one command in several read() calls pays for it once.
+ *
+ * Everything else here runs with dev->lock held, except the free functions.
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define __KERNEL__
+#include "../include/aesdchar.h"
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/lz4.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+/**
+ * @brief Free the decompression cache of a device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_compress_free(struct aesd_dev *dev)
+{
+    int i;
+
+    for (i = 0; i < AESD_LZ4_CACHE_SLOTS; i++)
+    {
+        kvfree(dev->lz4_cache[i].data);
+        dev->lz4_cache[i].key = NULL;
+        dev->lz4_cache[i].data = NULL;
+        dev->lz4_cache[i].alloc = 0;
+    }
+}
+
+/**
+ * @brief Free the LZ4 state of a file
+ * @param file Per-file state, no longer used for writing
+ */
+void aesd_compress_file_free(struct aesd_file *file)
+{
+    kvfree(file->lz4_scratch);
+    file->lz4_scratch = NULL;
+    file->lz4_scratch_size = 0;
+
+    kvfree(file->lz4_wrkmem);
+    file->lz4_wrkmem = NULL;
+}
+
+/**
+ * @brief Compress a completed command
+ * @param file Per-file state, with write_lock held
+ * @param data Command bytes
+ * @param size Command length
+ * @param stored_size Output, length of the returned block
+ * @return Newly allocated LZ4 block, or NULL to store the command plain
+ *
+ * Needs no dev->lock: the compressor state and output buffer belong to the
+ * file and are allocated on its first compressed command, the output buffer
+ * sized for the largest command seen.
+ *
+ * NULL is not an error: it is returned when compression is disabled, the
+ * command is too short to benefit, LZ4 does not shrink it, or memory is
+ * short. The block is allocated at its exact length, so the slack of the
+ * scratch buffer is never held by the circular buffer.
+ */
+char *aesd_compress_command(struct aesd_file *file, const char *data, size_t size, uint32_t *stored_size)
+{
+    size_t bound;
+    char *block;
+    int clen;
+
+    if (!file->dev->compress || size < AESD_LZ4_MIN_SIZE || size > LZ4_MAX_INPUT_SIZE)
+    {
+        return NULL;
+    }
+
+    if (!file->lz4_wrkmem)
+    {
+        file->lz4_wrkmem = kvmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+        if (!file->lz4_wrkmem)
+        {
+            return NULL;
+        }
+    }
+
+    bound = LZ4_compressBound(size);
+    if (bound > file->lz4_scratch_size)
+    {
+        kvfree(file->lz4_scratch);
+        file->lz4_scratch_size = 0;
+        file->lz4_scratch = kvmalloc(bound, GFP_KERNEL);
+        if (!file->lz4_scratch)
+        {
+            return NULL;
+        }
+        file->lz4_scratch_size = bound;
+    }
+
+    clen = LZ4_compress_default(data, file->lz4_scratch, size, file->lz4_scratch_size, file->lz4_wrkmem);
+    if (clen <= 0 || (size_t)clen >= size)
+    {
+        return NULL;
+    }
+
+    block = kmalloc(clen, GFP_KERNEL);
+    if (!block)
+    {
+        return NULL;
+    }
+
+    memcpy(block, file->lz4_scratch, clen);
+    *stored_size = clen;
+    return block;
+}
+
+/**
+ * @brief Return the plain bytes of an entry, decompressing through the cache
+ * @param dev Pointer to the AESD device structure
+ * @param entry Entry inside dev->buffer
+ * @return Pointer to entry->size bytes valid until dev->lock is released,
+ *         NULL if the entry could not be decompressed
+ *
+ * Plain entries are returned as is. On a cache miss the least recently
+ * filled slot is reused.
+ */
+const char *aesd_entry_data(struct aesd_dev *dev, const struct aesd_buffer_entry *entry)
+{
+    uint32_t stored = aesd_entry_meta(dev, entry)->stored_size;
+    struct aesd_lz4_cache_slot *slot;
+    int i;
+
+    if (!stored)
+    {
+        return entry->buffptr;
+    }
+
+    for (i = 0; i < AESD_LZ4_CACHE_SLOTS; i++)
+    {
+        if (dev->lz4_cache[i].key == entry->buffptr)
+        {
+            this_cpu_inc(dev->stats->lz4_cache_hits);
+            return dev->lz4_cache[i].data;
+        }
+    }
+
+    this_cpu_inc(dev->stats->lz4_cache_misses);
+    slot = &dev->lz4_cache[dev->lz4_cache_next];
+    dev->lz4_cache_next = (dev->lz4_cache_next + 1) % AESD_LZ4_CACHE_SLOTS;
+    slot->key = NULL;
+
+    if (entry->size > slot->alloc)
+    {
+        kvfree(slot->data);
+        slot->alloc = 0;
+        slot->data = kvmalloc(entry->size, GFP_KERNEL);
+        if (!slot->data)
+        {
+            return NULL;
+        }
+        slot->alloc = entry->size;
+    }
+
+    if (LZ4_decompress_safe(entry->buffptr, slot->data, stored, entry->size) != (int)entry->size)
+    {
+        return NULL;
+    }
+
+    slot->key = entry->buffptr;
+    return slot->data;
+}
+
+/**
+ * @brief Drop an entry from the decompression cache before it is freed
+ * @param dev Pointer to the AESD device structure
+ * @param buffptr buffptr of the entry being freed
+ *
+ * Required because a later command may be allocated at the same address.
+ */
+void aesd_compress_forget(struct aesd_dev *dev, const char *buffptr)
+{
+    int i;
+
+    for (i = 0; i < AESD_LZ4_CACHE_SLOTS; i++)
+    {
+        if (dev->lz4_cache[i].key == buffptr)
+        {
+            dev->lz4_cache[i].key = NULL;
+        }
+    }
+}
@@ -4,8 +4,10 @@
  *
  * This file implements the device initialization and cleanup functions
  * for the AESD character driver, including:
+ * - Per-instance state and entry storage allocation
  * - Character device structure setup and kernel registration
  * - Resource cleanup and memory management
+ * - Live capacity resize, migrating the held commands
  * - Integration with the kernel's character device framework
  *
  * @author Assignment Team
@@ -14,12 +16,71 @@
 
 #define __KERNEL__
 #include "../include/aesdchar.h"
+#include <linux/atomic.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
+#include <linux/string.h>
+
+/**
+ * @brief Initialize one device instance and allocate its entry storage
+ * @param dev Pointer to the AESD device structure, expected to be zeroed
+ * @param index Device index, selects minor number aesd_minor + index
+ * @param params Capacity, limits and storage mode of the device
+ * @return 0 on success, negative error code on failure
+ *
+ * Each instance gets its own mutex and circular buffer so producers on
+ * different minors never contend with each other. The cdev is not
+ * registered here; call aesd_setup_cdev() once the instance is ready.
+ */
+int aesd_init_device(struct aesd_dev *dev, unsigned int index, const struct aesd_dev_params *params)
+{
+    uint32_t max_entries;
+
+    if (!dev || !params || !params->max_entries || params->max_entries > AESD_MAX_ENTRIES)
+    {
+        return -EINVAL;
+    }
+    max_entries = params->max_entries;
+
+    dev->entries = kcalloc(max_entries, sizeof(*dev->entries), GFP_KERNEL);
+    dev->meta = kcalloc(max_entries, sizeof(*dev->meta), GFP_KERNEL);
+    if (!dev->entries || !dev->meta)
+    {
+        goto fail;
+    }
+
+    if (aesd_stats_init(dev))
+    {
+        goto fail;
+    }
+
+    dev->compress = params->compress;
+
+    dev->index = index;
+    dev->max_entries = max_entries;
+    dev->max_bytes = params->max_bytes;
+    dev->max_pending = params->max_pending;
+    dev->lossless = params->lossless;
+    INIT_LIST_HEAD(&dev->consumers);
+    init_waitqueue_head(&dev->space_wq);
+    dev->next_seq = 1;
+    mutex_init(&dev->lock);
+    aesd_circular_buffer_init_storage(&dev->buffer, dev->entries, max_entries);
+    return 0;
+
+fail:
+    aesd_stats_free(dev);
+    kfree(dev->meta);
+    dev->meta = NULL;
+    kfree(dev->entries);
+    dev->entries = NULL;
+    return -ENOMEM;
+}
 
 /**
  * @brief Setup and register the character device with the kernel
@@ -39,13 +100,14 @@
 int aesd_setup_cdev(struct aesd_dev *dev)
 {
     int err = 0;
-    dev_t devno = MKDEV(aesd_major, aesd_minor);
+    dev_t devno;
 
     /* Input validation */
     if (!dev)
     {
         return -EINVAL;
     }
+    devno = MKDEV(aesd_major, aesd_minor + dev->index);
 
     /* Initialize character device structure with file operations */
     cdev_init(&dev->cdev, &aesd_fops);
@@ -57,7 +119,7 @@ int aesd_setup_cdev(struct aesd_dev *dev)
     err = cdev_add(&dev->cdev, devno, 1);
     if (err)
     {
-        pr_err("Error %d adding aesd cdev", err);
+        pr_err("Error %d adding aesd cdev %u", err, dev->index);
     }
     return err;
 }
@@ -67,9 +129,11 @@ int aesd_setup_cdev(struct aesd_dev *dev)
  * @param dev Pointer to the AESD device structure
  *
  * This function performs comprehensive cleanup of all device resources:
- * 1. Frees any pending write buffer data
+ * 1. Frees the partial command orphaned by a closed file, if any
  * 2. Iterates through the circular buffer and frees all stored entries
  * 3. Clears all buffer entry pointers and sizes
+ * 4. Releases the entry storage and per-CPU counters allocated by
+ *    aesd_init_device()
  *
  * This function should be called during module unloading to ensure
  * no memory leaks occur. It safely handles the case where some
@@ -77,7 +141,7 @@ int aesd_setup_cdev(struct aesd_dev *dev)
  */
 void aesd_cleanup_device(struct aesd_dev *dev)
 {
-    uint8_t index;
+    uint32_t index;
     struct aesd_buffer_entry *entry = NULL;
 
     if (!dev)
@@ -85,12 +149,15 @@ void aesd_cleanup_device(struct aesd_dev *dev)
         return;
     }
 
-    /* Free any pending write buffer */
-    if (dev->write_buf)
+    /* Free the orphaned partial command, open files free their own */
+    if (dev->orphan_buf)
     {
-        kfree(dev->write_buf);
-        dev->write_buf = NULL;
-        dev->write_buf_size = 0;
+        kfree(dev->orphan_buf);
+        dev->orphan_buf = NULL;
+        dev->orphan_size = 0;
+        dev->orphan_alloc = 0;
+        atomic_long_set(&dev->pending_bytes, 0);
+        atomic_long_set(&dev->pending_alloc, 0);
     }
 
     /* Free all entries in the circular buffer */
@@ -103,4 +170,121 @@ void aesd_cleanup_device(struct aesd_dev *dev)
             entry->size = 0;
         }
     }
+
+    kfree(dev->entries);
+    dev->entries = NULL;
+    kfree(dev->meta);
+    dev->meta = NULL;
+    dev->stored_bytes = 0;
+    aesd_circular_buffer_init(&dev->buffer);
+    aesd_compress_free(dev);
+    aesd_stats_free(dev);
+}
+
+/**
+ * @brief Change the number of commands a device holds, keeping the newest ones
+ * @param dev Pointer to the AESD device structure
+ * @param max_entries New capacity, 1 to AESD_MAX_ENTRIES
+ * @return 0 on success, -EINVAL for a capacity out of range, -ENOMEM, -ERESTARTSYS,
+ *         or -EBUSY when a lossless device would drop unread commands
+ *
+ * The new entry and metadata arrays are allocated before dev->lock is
+ * taken, and the dropped commands and old arrays are freed after it is
+ * released, so the lock is held only to move the surviving entries. When
+ * shrinking, the oldest commands are dropped and counted as evictions.
+ * Stream offsets are kept, so consumer cursors stay valid; writers waiting
+ * in lossless mode are woken since a larger ring may have room for them.
+ */
+int aesd_resize_device(struct aesd_dev *dev, uint32_t max_entries)
+{
+    struct aesd_buffer_entry *entries;
+    struct aesd_buffer_entry *old_entries;
+    struct aesd_entry_meta *meta;
+    struct aesd_entry_meta *old_meta;
+    uint32_t old_capacity;
+    uint32_t old_out;
+    uint32_t count;
+    uint32_t drop;
+    uint32_t i;
+    int result = 0;
+
+    if (!dev || !max_entries || max_entries > AESD_MAX_ENTRIES)
+    {
+        return -EINVAL;
+    }
+
+    entries = kcalloc(max_entries, sizeof(*entries), GFP_KERNEL);
+    meta = kcalloc(max_entries, sizeof(*meta), GFP_KERNEL);
+    if (!entries || !meta)
+    {
+        result = -ENOMEM;
+        goto out_free;
+    }
+
+    if (aesd_dev_lock(dev))
+    {
+        result = -ERESTARTSYS;
+        goto out_free;
+    }
+
+    count = aesd_circular_buffer_count(&dev->buffer);
+    drop = count > max_entries ? count - max_entries : 0;
+
+    /* In lossless mode only commands every consumer has read may be dropped */
+    if (dev->lossless && drop)
+    {
+        struct aesd_buffer_entry *last = aesd_circular_buffer_entry_at(&dev->buffer, drop - 1);
+
+        if (aesd_entry_meta(dev, last)->stream_offset + last->size > aesd_lossless_consumed(dev))
+        {
+            aesd_dev_unlock(dev);
+            result = -EBUSY;
+            goto out_free;
+        }
+    }
+
+    /* Forget the dropped commands; their memory is freed once unlocked */
+    for (i = 0; i < drop; i++)
+    {
+        struct aesd_buffer_entry *victim = aesd_circular_buffer_entry_at(&dev->buffer, i);
+
+        dev->stored_bytes -= aesd_entry_stored_size(dev, victim);
+        if (aesd_entry_meta(dev, victim)->stored_size)
+        {
+            aesd_compress_forget(dev, victim->buffptr);
+        }
+        this_cpu_inc(dev->stats->evictions);
+    }
+
+    /* Move the survivors, oldest first, into slots 0 .. count - drop - 1 */
+    old_entries = dev->entries;
+    old_meta = dev->meta;
+    old_capacity = dev->buffer.capacity;
+    old_out = dev->buffer.out_offs;
+    aesd_circular_buffer_init_storage(&dev->buffer, entries, max_entries);
+    for (i = drop; i < count; i++)
+    {
+        uint32_t slot = (old_out + i) % old_capacity;
+
+        meta[i - drop] = old_meta[slot];
+        aesd_circular_buffer_add_entry(&dev->buffer, &old_entries[slot]);
+    }
+
+    dev->entries = entries;
+    dev->meta = meta;
+    WRITE_ONCE(dev->max_entries, max_entries);
+    aesd_lossless_wake(dev);
+    aesd_dev_unlock(dev);
+
+    for (i = 0; i < drop; i++)
+    {
+        kfree((void *)old_entries[(old_out + i) % old_capacity].buffptr);
+    }
+    entries = old_entries;
+    meta = old_meta;
+
+out_free:
+    kfree(meta);
+    kfree(entries);
+    return result;
 }
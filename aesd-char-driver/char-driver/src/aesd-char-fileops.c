@@ -7,9 +7,17 @@
  *
  * Key features implemented:
  * - Basic file operations (open, release, read, write)
- * - llseek support for SEEK_SET, SEEK_CUR, and SEEK_END
- * - ioctl support for AESDCHAR_IOCSEEKTO command
+ * - read_iter/write_iter for readv/writev, with splice and sendfile on top
+ * - llseek support for SEEK_SET, SEEK_CUR and SEEK_END, plus SEEK_DATA and
+ *   SEEK_HOLE stepping between command boundaries
+ * - ioctl support for AESDCHAR_IOCSEEKTO, AESDCHAR_IOCGETINFO,
+ *   AESDCHAR_IOCSNAPSHOT, AESDCHAR_IOCPREAD, AESDCHAR_IOCSEEKTIME and
+ *   AESDCHAR_IOCCONSUMER and AESDCHAR_IOCRESIZE commands
+ * - Per-file state (struct aesd_file): write staging, consumer cursor and
+ *   lossless-mode flow control
  * - Thread-safe operations using mutex locks
+ * - Latency histograms for read, write and llseek (see aesd-char-stats.c)
+ * - Tracepoints on every operation (see aesd-char-trace.h)
  *
  * @author Ekpenyong-Esu
  * @date June 7, 2025
@@ -17,40 +25,136 @@
 
 #define __KERNEL__
 #include "../../aesd_ioctl.h"
+#include "../include/aesd-char-trace.h"
 #include "../include/aesdchar.h"
+#include <linux/capability.h>
 #include <linux/cdev.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#include <linux/wait.h>
 
 /**
  * @brief Open the AESD character device
  * @param inode The inode structure
  * @param filp The file structure
- * @return 0 on success
+ * @return 0 on success, -ENOMEM if the per-file state cannot be allocated
+ *
+ * Every open file gets its own struct aesd_file in private_data, which
+ * also stages the file's partial command.
  */
 int aesd_open(struct inode *inode, struct file *filp)
 {
-    struct aesd_dev *dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-    filp->private_data = dev;
+    struct aesd_file *file = kzalloc(sizeof(*file), GFP_KERNEL);
+
+    if (!file)
+    {
+        return -ENOMEM;
+    }
+
+    file->dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    INIT_LIST_HEAD(&file->consumer_node);
+    mutex_init(&file->write_lock);
+    filp->private_data = file;
     return 0;
 }
 
+/**
+ * @brief Unregister a consumer, letting writers it held back proceed
+ * @param file Per-file state, must be registered
+ *
+ * Must be called with dev->lock held.
+ */
+static void aesd_consumer_remove(struct aesd_file *file)
+{
+    list_del_init(&file->consumer_node);
+    file->consumer = false;
+    aesd_lossless_wake(file->dev);
+}
+
 /**
  * @brief Release the AESD character device
  * @param inode The inode structure
  * @param filp The file structure
  * @return 0 on success
+ *
+ * Drops the file's consumer registration, taking the lock uninterruptibly
+ * since release cannot fail, hands a partial command over to the device
+ * so the next write continues it, and frees the per-file state.
  */
 int aesd_release(struct inode *inode, struct file *filp)
 {
+    struct aesd_file *file = filp->private_data;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (file->consumer)
+    {
+        mutex_lock(&file->dev->lock);
+        aesd_consumer_remove(file);
+        mutex_unlock(&file->dev->lock);
+    }
+
+    aesd_orphan_partial(file);
+    aesd_compress_file_free(file);
+    kfree(file);
+    filp->private_data = NULL;
     return 0;
 }
 
+/**
+ * @brief Load a consumer's cursor into a file position
+ * @param file Per-file state
+ * @param pos File position to overwrite, left alone for non-consumers
+ *
+ * Consumers read from their stream cursor, which stays put when older
+ * commands are evicted, instead of f_pos, which would shift. A cursor
+ * behind the oldest held byte (lossy mode) restarts at position 0.
+ * Must be called with dev->lock held.
+ */
+static void aesd_consumer_load(struct aesd_file *file, loff_t *pos)
+{
+    u64 base;
+
+    if (!file->consumer)
+    {
+        return;
+    }
+
+    base = aesd_stream_base(file->dev);
+    *pos = file->stream_pos > base ? file->stream_pos - base : 0;
+}
+
+/**
+ * @brief Store a file position as a consumer's cursor
+ * @param file Per-file state
+ * @param pos New file position
+ *
+ * Wakes lossless-mode writers, since the consumer may have moved past the
+ * oldest command. Must be called with dev->lock held.
+ */
+static void aesd_consumer_store(struct aesd_file *file, loff_t pos)
+{
+    if (!file->consumer)
+    {
+        return;
+    }
+
+    file->stream_pos = aesd_stream_base(file->dev) + pos;
+    aesd_lossless_wake(file->dev);
+}
+
 /**
  * @brief Read operation for the AESD character device
  * @param filp Pointer to the file structure
@@ -70,12 +174,15 @@ int aesd_release(struct inode *inode, struct file *filp)
  * - -EINVAL: Invalid parameters
  * - -ERESTARTSYS: Interrupted by signal while waiting for mutex
  * - -EFAULT: Failed to copy data to user space
+ * - -EIO: A compressed command could not be decompressed
  */
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+static ssize_t __aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
 {
     ssize_t retval = 0;
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(filp);
     struct aesd_buffer_entry *entry;
+    const char *data;
     size_t entry_offset = 0;
     size_t bytes_to_read;
 
@@ -84,30 +191,60 @@ ssize_t aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_p
         return -EINVAL;
     }
 
-    if (mutex_lock_interruptible(&dev->lock))
+    if (aesd_dev_lock(dev))
     {
         return -ERESTARTSYS;
     }
 
+    aesd_consumer_load(file, f_pos);
     entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, *f_pos, &entry_offset);
     if (!entry)
     {
-        mutex_unlock(&dev->lock);
-        return 0; // EOF - no more data
+        goto out; // EOF - no more data
+    }
+
+    data = aesd_entry_data(dev, entry);
+    if (!data)
+    {
+        retval = -EIO;
+        goto out;
     }
 
     bytes_to_read = min(count, entry->size - entry_offset);
-    if (copy_to_user(buf, entry->buffptr + entry_offset, bytes_to_read))
+    if (copy_to_user(buf, data + entry_offset, bytes_to_read))
     {
         retval = -EFAULT;
         goto out;
     }
 
     *f_pos += bytes_to_read;
+    aesd_consumer_store(file, *f_pos);
     retval = bytes_to_read;
+    this_cpu_inc(dev->stats->reads);
+    this_cpu_add(dev->stats->bytes_read, bytes_to_read);
 
 out:
-    mutex_unlock(&dev->lock);
+    trace_aesd_read(MINOR(dev->cdev.dev), *f_pos - (retval > 0 ? retval : 0), count,
+                    entry ? (int)aesd_circular_buffer_entry_index(&dev->buffer, entry) : -1, entry_offset, retval,
+                    dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+    return retval;
+}
+
+/**
+ * @brief read() entry point, records the call in the aesd_read latency histogram
+ * @param filp Pointer to the file structure
+ * @param buf User space buffer to read data into
+ * @param count Number of bytes requested to read
+ * @param f_pos Pointer to current file position
+ * @return Result of __aesd_read()
+ */
+ssize_t aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+{
+    u64 start = ktime_get_ns();
+    ssize_t retval = __aesd_read(filp, buf, count, f_pos);
+
+    aesd_stats_latency(aesd_file_dev(filp), AESD_LAT_READ, start);
     return retval;
 }
 
@@ -116,47 +253,50 @@ out:
  * @param buffer Pointer to the circular buffer
  * @return Total size of all valid entries in the buffer
  *
- * This function iterates through all valid entries in the circular buffer
- * and calculates the cumulative size. Used by llseek for SEEK_END operations
- * and for bounds checking.
+ * The circular buffer keeps a running total as entries are added and
+ * removed, so this is constant time. Used by llseek for SEEK_END
+ * operations and for bounds checking.
  */
 static size_t aesd_get_total_buffer_size(struct aesd_circular_buffer *buffer)
 {
-    size_t total_size = 0;
-    uint8_t current_idx = buffer->out_offs;
-    uint8_t entries_checked = 0;
-    uint8_t total_entries;
+    return buffer->total_size;
+}
 
-    // Calculate total valid entries in the circular buffer
-    if (buffer->full)
-    {
-        total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-    }
-    else if (buffer->in_offs >= buffer->out_offs)
-    {
-        total_entries = buffer->in_offs - buffer->out_offs;
-    }
-    else
-    {
-        total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs + buffer->in_offs;
-    }
+/**
+ * @brief Find the command holding a file position
+ * @param dev Pointer to the AESD device structure, with dev->lock held
+ * @param pos File position, below dev->buffer.total_size
+ * @return The entry whose bytes include pos
+ *
+ * Binary search for the last command starting at or before pos, using the
+ * O(1) positions derived from the entries' stream offsets.
+ */
+static struct aesd_buffer_entry *aesd_entry_for_pos(struct aesd_dev *dev, loff_t pos)
+{
+    uint32_t low = 0;
+    uint32_t high = aesd_circular_buffer_count(&dev->buffer) - 1;
 
-    // Sum up sizes of all valid entries
-    while (entries_checked < total_entries)
+    while (low < high)
     {
-        total_size += buffer->entry[current_idx].size;
-        current_idx = (current_idx + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-        entries_checked++;
-    }
+        uint32_t mid = low + (high - low + 1) / 2;
 
-    return total_size;
+        if (aesd_entry_pos(dev, aesd_circular_buffer_entry_at(&dev->buffer, mid)) <= pos)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    return aesd_circular_buffer_entry_at(&dev->buffer, low);
 }
 
 /**
  * @brief Implement llseek file operation for AESD character driver
  * @param filp Pointer to the file structure
  * @param offset Offset value for seeking
- * @param whence Seek mode (SEEK_SET, SEEK_CUR, SEEK_END)
+ * @param whence Seek mode (SEEK_SET, SEEK_CUR, SEEK_END, SEEK_DATA, SEEK_HOLE)
  * @return New file position on success, negative error code on failure
  *
  * This function implements seeking within the circular buffer data.
@@ -164,12 +304,23 @@ static size_t aesd_get_total_buffer_size(struct aesd_circular_buffer *buffer)
  * - SEEK_SET: Absolute position from beginning
  * - SEEK_CUR: Relative position from current location
  * - SEEK_END: Position relative to end of buffer
+ * - SEEK_DATA: offset itself, as lseek(2) requires for an offset in data
+ * - SEEK_HOLE: End of the command containing offset, i.e. the start of the
+ *   next command, or the end of the buffer for the newest one
  *
- * Returns -EINVAL for out-of-bounds seeks or invalid whence values.
+ * SEEK_DATA and SEEK_HOLE treat every command as a data extent followed by
+ * a zero-width hole, so lseek(fd, pos, SEEK_HOLE) steps to the next command
+ * in O(log n). The held data has no gaps, so SEEK_DATA only validates the
+ * offset; the start of a command is reached with AESDCHAR_IOCSEEKTO.
+ *
+ * Returns -EINVAL for out-of-bounds seeks or invalid whence values, and
+ * -ENXIO for a SEEK_DATA or SEEK_HOLE offset outside the held data.
  */
-loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
+static loff_t __aesd_llseek(struct file *filp, loff_t offset, int whence)
 {
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_buffer_entry *entry;
     loff_t new_pos;
     size_t total_size;
 
@@ -178,12 +329,13 @@ loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
         return -EINVAL;
     }
 
-    if (mutex_lock_interruptible(&dev->lock))
+    if (aesd_dev_lock(dev))
     {
         return -ERESTARTSYS;
     }
 
     total_size = aesd_get_total_buffer_size(&dev->buffer);
+    aesd_consumer_load(file, &filp->f_pos);
 
     // Calculate new position based on seek mode
     switch (whence)
@@ -197,113 +349,719 @@ loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
     case SEEK_END:
         new_pos = total_size + offset; // Relative to end of buffer
         break;
+    case SEEK_DATA:
+    case SEEK_HOLE:
+        if (offset < 0 || offset >= total_size)
+        {
+            new_pos = -ENXIO; // No command holds this offset
+            goto out;
+        }
+        new_pos = offset; // Already in data
+        if (whence == SEEK_HOLE)
+        {
+            entry = aesd_entry_for_pos(dev, offset);
+            new_pos = aesd_entry_pos(dev, entry) + entry->size; // Boundary with the next command
+        }
+        break;
     default:
-        mutex_unlock(&dev->lock);
-        return -EINVAL; // Invalid whence parameter
+        new_pos = -EINVAL; // Invalid whence parameter
+        goto out;
     }
 
     // Validate bounds - position must be within buffer range
     if (new_pos < 0 || new_pos > total_size)
     {
-        mutex_unlock(&dev->lock);
-        return -EINVAL; // Out of bounds seek
+        new_pos = -EINVAL; // Out of bounds seek
+        goto out;
     }
 
     filp->f_pos = new_pos; // Update file position
-    mutex_unlock(&dev->lock);
-    return new_pos; // Return new position
+    aesd_consumer_store(file, new_pos);
+
+out:
+    trace_aesd_llseek(MINOR(dev->cdev.dev), offset, whence, total_size, new_pos, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+    return new_pos; // New position or error
 }
 
 /**
- * @brief Handle ioctl commands for AESD character driver
+ * @brief llseek() entry point, records the call in the aesd_llseek latency histogram
  * @param filp Pointer to the file structure
- * @param cmd The ioctl command number
- * @param arg User space argument (typically a pointer to data structure)
+ * @param offset Offset value for seeking
+ * @param whence Seek mode (SEEK_SET, SEEK_CUR, SEEK_END, SEEK_DATA, SEEK_HOLE)
+ * @return Result of __aesd_llseek()
+ */
+loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
+{
+    u64 start = ktime_get_ns();
+    loff_t retval = __aesd_llseek(filp, offset, whence);
+
+    aesd_stats_latency(aesd_file_dev(filp), AESD_LAT_LLSEEK, start);
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCSEEKTO: seek to a command index and an offset within it
+ * @param filp Pointer to the file structure, its f_pos is updated
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a struct aesd_seekto
  * @return 0 on success, negative error code on failure
  *
- * Currently supports:
- * - AESDCHAR_IOCSEEKTO: Seek to a specific command and offset within that command
- *   Takes a struct aesd_seekto with write_cmd (command index) and
- *   write_cmd_offset (byte offset within the command)
- *
  * The function validates both the command index and offset before seeking.
- * Returns -EINVAL for invalid parameters, -EFAULT for copy_from_user errors.
  */
-long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+static long aesd_ioctl_seekto(struct file *filp, struct aesd_dev *dev, unsigned long arg)
 {
-    struct aesd_dev *dev = filp->private_data;
     struct aesd_seekto seekto;
     loff_t new_pos = 0;
-    uint8_t current_idx;
-    uint8_t entries_checked = 0;
-    uint8_t total_entries;
+    struct aesd_buffer_entry *target;
+    long retval = 0;
 
-    if (!dev)
+    // Safely copy the seekto structure from user space
+    if (copy_from_user(&seekto, (struct aesd_seekto __user *)arg, sizeof(seekto)))
     {
-        return -EINVAL;
+        return -EFAULT;
     }
 
-    switch (cmd)
+    if (aesd_dev_lock(dev))
     {
-    case AESDCHAR_IOCSEEKTO:
-        // Safely copy the seekto structure from user space
-        if (copy_from_user(&seekto, (struct aesd_seekto __user *)arg, sizeof(seekto)))
+        return -ERESTARTSYS;
+    }
+
+    // Validate command index is within available entries
+    if (seekto.write_cmd >= aesd_circular_buffer_count(&dev->buffer))
+    {
+        retval = -EINVAL;
+        goto out;
+    }
+
+    // Find the target entry, its stream offset gives the position directly
+    target = aesd_circular_buffer_entry_at(&dev->buffer, seekto.write_cmd);
+    new_pos = aesd_entry_pos(dev, target);
+
+    // Validate offset within the command
+    if (seekto.write_cmd_offset >= target->size)
+    {
+        retval = -EINVAL;
+        goto out;
+    }
+
+    new_pos += seekto.write_cmd_offset;
+    filp->f_pos = new_pos;
+    aesd_consumer_store(filp->private_data, new_pos);
+
+out:
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCSEEKTO, seekto.write_cmd, seekto.write_cmd_offset, filp->f_pos,
+                     retval, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCGETINFO: report buffer metadata and command lengths
+ * @param filp Pointer to the file structure
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a struct aesd_info
+ * @return 0 on success, negative error code on failure
+ *
+ * The lengths are gathered into a kernel array under the lock and copied
+ * out afterwards, so the user copy never extends the lock hold.
+ */
+static long aesd_ioctl_getinfo(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_info info;
+    uint32_t *lengths = NULL;
+    uint32_t lengths_max;
+    uint32_t i;
+    long retval = 0;
+
+    if (copy_from_user(&info, (struct aesd_info __user *)arg, sizeof(info)))
+    {
+        return -EFAULT;
+    }
+
+    /* Never allocate more slots than the device can hold */
+    lengths_max = min_t(uint32_t, info.lengths_len, READ_ONCE(dev->max_entries));
+    if (lengths_max)
+    {
+        lengths = kmalloc_array(lengths_max, sizeof(*lengths), GFP_KERNEL);
+        if (!lengths)
         {
-            return -EFAULT;
+            return -ENOMEM;
         }
+    }
+
+    if (aesd_dev_lock(dev))
+    {
+        kfree(lengths);
+        return -ERESTARTSYS;
+    }
 
-        if (mutex_lock_interruptible(&dev->lock))
+    info.entry_count = aesd_circular_buffer_count(&dev->buffer);
+    info.capacity = dev->buffer.capacity;
+    info.total_bytes = dev->buffer.total_size;
+    info.newest_seq = dev->next_seq - 1;
+    info.oldest_seq = dev->next_seq - info.entry_count;
+    info.lengths_filled = min(lengths_max, info.entry_count);
+    for (i = 0; i < info.lengths_filled; i++)
+    {
+        lengths[i] = aesd_circular_buffer_entry_at(&dev->buffer, i)->size;
+    }
+
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCGETINFO, info.entry_count, info.lengths_filled, filp->f_pos,
+                     0, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+
+    if (info.lengths_filled && copy_to_user(u64_to_user_ptr(info.lengths_ptr), lengths,
+                                            info.lengths_filled * sizeof(*lengths)))
+    {
+        retval = -EFAULT;
+    }
+    else if (copy_to_user((struct aesd_info __user *)arg, &info, sizeof(info)))
+    {
+        retval = -EFAULT;
+    }
+
+    kfree(lengths);
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCSNAPSHOT: copy a range of whole commands in one lock hold
+ * @param filp Pointer to the file structure, its f_pos is not used or changed
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a struct aesd_snapshot
+ * @return 0 on success, negative error code on failure
+ *
+ * The user copies run with dev->lock held so that writers cannot change the
+ * buffer between commands. This is safe because the device cannot be
+ * mmap'd, so faulting in the destination never needs dev->lock.
+ */
+static long aesd_ioctl_snapshot(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_snapshot snap;
+    char __user *dst;
+    uint32_t __user *lengths;
+    uint32_t count;
+    uint32_t last;
+    uint32_t i;
+    long retval = 0;
+
+    if (copy_from_user(&snap, (struct aesd_snapshot __user *)arg, sizeof(snap)))
+    {
+        return -EFAULT;
+    }
+    dst = u64_to_user_ptr(snap.buf_ptr);
+    lengths = u64_to_user_ptr(snap.lengths_ptr);
+
+    if (aesd_dev_lock(dev))
+    {
+        return -ERESTARTSYS;
+    }
+
+    count = aesd_circular_buffer_count(&dev->buffer);
+    if (snap.first_cmd > count)
+    {
+        retval = -EINVAL;
+        goto out;
+    }
+
+    /* Resolve the requested range [first_cmd, last) */
+    last = count;
+    if (snap.max_cmds && snap.max_cmds < count - snap.first_cmd)
+    {
+        last = snap.first_cmd + snap.max_cmds;
+    }
+
+    snap.cmd_count = 0;
+    snap.bytes_copied = 0;
+    snap.bytes_needed = 0;
+    snap.first_seq = dev->next_seq - count + snap.first_cmd;
+    for (i = snap.first_cmd; i < last; i++)
+    {
+        struct aesd_buffer_entry *entry = aesd_circular_buffer_entry_at(&dev->buffer, i);
+        const char *data;
+        bool fits = snap.cmd_count == i - snap.first_cmd && snap.bytes_copied + entry->size <= snap.buf_len &&
+                    (!lengths || snap.cmd_count < snap.lengths_len);
+
+        snap.bytes_needed += entry->size;
+        if (!fits)
         {
-            return -ERESTARTSYS;
+            continue;
         }
 
-        // Calculate total valid entries in the circular buffer
-        if (dev->buffer.full)
+        data = aesd_entry_data(dev, entry);
+        if (!data)
         {
-            total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            retval = -EIO;
+            goto out;
         }
-        else if (dev->buffer.in_offs >= dev->buffer.out_offs)
+
+        if (copy_to_user(dst + snap.bytes_copied, data, entry->size) ||
+            (lengths && put_user((uint32_t)entry->size, &lengths[snap.cmd_count])))
         {
-            total_entries = dev->buffer.in_offs - dev->buffer.out_offs;
+            retval = -EFAULT;
+            goto out;
         }
-        else
+        snap.bytes_copied += entry->size;
+        snap.cmd_count++;
+    }
+
+    this_cpu_inc(dev->stats->reads);
+    this_cpu_add(dev->stats->bytes_read, snap.bytes_copied);
+
+out:
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCSNAPSHOT, snap.first_cmd, snap.cmd_count, filp->f_pos,
+                     retval, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+
+    if (!retval && copy_to_user((struct aesd_snapshot __user *)arg, &snap, sizeof(snap)))
+    {
+        retval = -EFAULT;
+    }
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCPREAD: read from a command index and offset
+ * @param filp Pointer to the file structure, its f_pos is not used
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a struct aesd_pread
+ * @return 0 on success, negative error code on failure
+ *
+ * Validates the position like AESDCHAR_IOCSEEKTO, then copies consecutive
+ * commands into the user buffer within the same lock hold, as
+ * aesd_ioctl_snapshot() does. Sharing one open file between threads is
+ * safe because f_pos is neither read nor written.
+ */
+static long aesd_ioctl_pread(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_pread pr;
+    struct aesd_buffer_entry *entry;
+    char __user *dst;
+    size_t entry_offset;
+    uint32_t count;
+    uint32_t i;
+    long retval = 0;
+
+    if (copy_from_user(&pr, (struct aesd_pread __user *)arg, sizeof(pr)))
+    {
+        return -EFAULT;
+    }
+    dst = u64_to_user_ptr(pr.buf_ptr);
+
+    if (aesd_dev_lock(dev))
+    {
+        return -ERESTARTSYS;
+    }
+
+    pr.bytes_copied = 0;
+    pr.bytes_available = 0;
+
+    count = aesd_circular_buffer_count(&dev->buffer);
+    if (pr.write_cmd >= count ||
+        pr.write_cmd_offset >= aesd_circular_buffer_entry_at(&dev->buffer, pr.write_cmd)->size)
+    {
+        retval = -EINVAL;
+        goto out;
+    }
+
+    entry_offset = pr.write_cmd_offset;
+    for (i = pr.write_cmd; i < count; i++, entry_offset = 0)
+    {
+        const char *data;
+        size_t chunk;
+
+        entry = aesd_circular_buffer_entry_at(&dev->buffer, i);
+        pr.bytes_available += entry->size - entry_offset;
+
+        chunk = min_t(u64, entry->size - entry_offset, pr.buf_len - pr.bytes_copied);
+        if (!chunk)
         {
-            total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - dev->buffer.out_offs + dev->buffer.in_offs;
+            continue;
         }
 
-        // Validate command index is within available entries
-        if (seekto.write_cmd >= total_entries)
+        data = aesd_entry_data(dev, entry);
+        if (!data)
         {
-            mutex_unlock(&dev->lock);
-            return -EINVAL;
+            retval = -EIO;
+            goto out;
         }
 
-        // Find the target entry and calculate position
-        current_idx = dev->buffer.out_offs;
-        for (entries_checked = 0; entries_checked < seekto.write_cmd; entries_checked++)
+        if (copy_to_user(dst + pr.bytes_copied, data + entry_offset, chunk))
         {
-            new_pos += dev->buffer.entry[current_idx].size;
-            current_idx = (current_idx + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            retval = -EFAULT;
+            goto out;
         }
+        pr.bytes_copied += chunk;
+    }
 
-        // Validate offset within the command
-        if (seekto.write_cmd_offset >= dev->buffer.entry[current_idx].size)
+    this_cpu_inc(dev->stats->reads);
+    this_cpu_add(dev->stats->bytes_read, pr.bytes_copied);
+
+out:
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCPREAD, pr.write_cmd, pr.write_cmd_offset, filp->f_pos, retval,
+                     dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+
+    if (!retval && copy_to_user((struct aesd_pread __user *)arg, &pr, sizeof(pr)))
+    {
+        retval = -EFAULT;
+    }
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCSEEKTIME: seek to the first command completed at or after a time
+ * @param filp Pointer to the file structure, its f_pos is updated
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a struct aesd_seektime
+ * @return 0 on success, negative error code on failure
+ *
+ * Entry timestamps are non-decreasing from oldest to newest, so a lower
+ * bound binary search over the command indices finds the entry, and its
+ * stream offset gives the file position without summing sizes.
+ */
+static long aesd_ioctl_seektime(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_seektime st;
+    struct aesd_buffer_entry *entry;
+    uint32_t low = 0;
+    uint32_t high;
+    long retval = 0;
+
+    if (copy_from_user(&st, (struct aesd_seektime __user *)arg, sizeof(st)))
+    {
+        return -EFAULT;
+    }
+
+    if (st.reserved)
+    {
+        return -EINVAL;
+    }
+
+    if (aesd_dev_lock(dev))
+    {
+        return -ERESTARTSYS;
+    }
+
+    /* Lower bound: first index whose timestamp is >= time_ns */
+    high = aesd_circular_buffer_count(&dev->buffer);
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        entry = aesd_circular_buffer_entry_at(&dev->buffer, mid);
+        if (aesd_entry_meta(dev, entry)->timestamp_ns < st.time_ns)
         {
-            mutex_unlock(&dev->lock);
-            return -EINVAL;
+            low = mid + 1;
         }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    st.write_cmd = low;
+    if (low < aesd_circular_buffer_count(&dev->buffer))
+    {
+        entry = aesd_circular_buffer_entry_at(&dev->buffer, low);
+        st.entry_time_ns = aesd_entry_meta(dev, entry)->timestamp_ns;
+        st.pos = aesd_entry_pos(dev, entry);
+    }
+    else
+    {
+        st.entry_time_ns = 0;
+        st.pos = dev->buffer.total_size;
+    }
+    filp->f_pos = st.pos;
+    aesd_consumer_store(filp->private_data, st.pos);
 
-        new_pos += seekto.write_cmd_offset;
-        filp->f_pos = new_pos;
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCSEEKTIME, st.write_cmd, 0, filp->f_pos, retval,
+                     dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
 
-        mutex_unlock(&dev->lock);
-        return 0;
+    if (copy_to_user((struct aesd_seektime __user *)arg, &st, sizeof(st)))
+    {
+        retval = -EFAULT;
+    }
+    return retval;
+}
+
+/**
+ * @brief AESDCHAR_IOCCONSUMER: register or unregister the file as a consumer
+ * @param filp Pointer to the file structure
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to a uint32_t, nonzero registers, 0 unregisters
+ * @return 0 on success, negative error code on failure
+ *
+ * A new consumer's cursor starts at the file's current position. From then
+ * on its reads and seeks move the cursor, and in lossless mode writers
+ * never evict a command the slowest consumer has not read past.
+ */
+static long aesd_ioctl_consumer(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    struct aesd_file *file = filp->private_data;
+    uint32_t enable;
+
+    if (get_user(enable, (uint32_t __user *)arg))
+    {
+        return -EFAULT;
+    }
+
+    if (aesd_dev_lock(dev))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if (enable && !file->consumer)
+    {
+        file->consumer = true;
+        file->stream_pos = aesd_stream_base(dev) + min_t(loff_t, filp->f_pos, dev->buffer.total_size);
+        list_add_tail(&file->consumer_node, &dev->consumers);
+    }
+    else if (!enable && file->consumer)
+    {
+        aesd_consumer_remove(file);
+    }
+
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCCONSUMER, enable, 0, filp->f_pos, 0, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+    return 0;
+}
+
+/**
+ * @brief AESDCHAR_IOCRESIZE: change the number of commands the device holds
+ * @param filp Pointer to the file structure, must be open for writing
+ * @param dev Pointer to the AESD device structure
+ * @param arg User space pointer to the new uint32_t capacity
+ * @return 0 on success, negative error code on failure
+ *
+ * The device node is usually world-writable, and a resize drops history
+ * for every user, so it takes CAP_SYS_ADMIN like the root-only sysfs
+ * attribute.
+ */
+static long aesd_ioctl_resize(struct file *filp, struct aesd_dev *dev, unsigned long arg)
+{
+    uint32_t max_entries;
+    long result;
+
+    if (!(filp->f_mode & FMODE_WRITE))
+    {
+        return -EBADF;
+    }
+
+    if (!capable(CAP_SYS_ADMIN))
+    {
+        return -EPERM;
+    }
+
+    if (get_user(max_entries, (uint32_t __user *)arg))
+    {
+        return -EFAULT;
+    }
+
+    result = aesd_resize_device(dev, max_entries);
+    trace_aesd_ioctl(MINOR(dev->cdev.dev), AESDCHAR_IOCRESIZE, max_entries, 0, filp->f_pos, result, 0);
+    return result;
+}
+
+/**
+ * @brief Handle ioctl commands for AESD character driver
+ * @param filp Pointer to the file structure
+ * @param cmd The ioctl command number
+ * @param arg User space argument (typically a pointer to data structure)
+ * @return 0 on success, negative error code on failure
+ *
+ * Currently supports:
+ * - AESDCHAR_IOCSEEKTO: Seek to a specific command and offset within that command
+ *   Takes a struct aesd_seekto with write_cmd (command index) and
+ *   write_cmd_offset (byte offset within the command)
+ * - AESDCHAR_IOCGETINFO: Return entry count, total bytes, oldest/newest
+ *   sequence numbers and per-command lengths in a struct aesd_info
+ * - AESDCHAR_IOCSNAPSHOT: Copy a range of whole commands and their lengths
+ *   into a user buffer under a single lock hold
+ * - AESDCHAR_IOCPREAD: Read from a command index and offset without
+ *   touching the file position
+ * - AESDCHAR_IOCSEEKTIME: Seek to the first command completed at or after
+ *   a CLOCK_REALTIME time, by binary search
+ * - AESDCHAR_IOCCONSUMER: Register the file as a consumer whose progress
+ *   gates writers in lossless mode
+ * - AESDCHAR_IOCRESIZE: Change the device's capacity, keeping the newest
+ *   commands
+ *
+ * Returns -EINVAL for invalid parameters, -EFAULT for copy_from_user errors
+ * and -ENOTTY for unknown commands.
+ */
+long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+
+    if (!dev)
+    {
+        return -EINVAL;
+    }
+
+    this_cpu_inc(dev->stats->ioctls);
+
+    switch (cmd)
+    {
+    case AESDCHAR_IOCSEEKTO:
+        return aesd_ioctl_seekto(filp, dev, arg);
+
+    case AESDCHAR_IOCGETINFO:
+        return aesd_ioctl_getinfo(filp, dev, arg);
+
+    case AESDCHAR_IOCSNAPSHOT:
+        return aesd_ioctl_snapshot(filp, dev, arg);
+
+    case AESDCHAR_IOCPREAD:
+        return aesd_ioctl_pread(filp, dev, arg);
+
+    case AESDCHAR_IOCSEEKTIME:
+        return aesd_ioctl_seektime(filp, dev, arg);
+
+    case AESDCHAR_IOCCONSUMER:
+        return aesd_ioctl_consumer(filp, dev, arg);
+
+    case AESDCHAR_IOCRESIZE:
+        return aesd_ioctl_resize(filp, dev, arg);
 
     default:
         return -ENOTTY;
     }
 }
 
+/**
+ * @brief Check a write against the device's pending limit before copying it
+ * @param dev Pointer to the AESD device structure
+ * @param count Number of bytes about to be written
+ * @return 0 if the write may fit, -ENOSPC if it never can
+ *
+ * Stops an oversized write before its kernel bounce buffer is allocated.
+ * Whether it fits next to the file's pending command is decided later,
+ * under the file's write_lock, by aesd_handle_write_buffer().
+ */
+static int aesd_write_check_size(struct aesd_dev *dev, size_t count)
+{
+    if (dev->max_pending && count > dev->max_pending)
+    {
+        this_cpu_inc(dev->stats->pending_rejects);
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+/**
+ * @brief Append kernel-space data to a file's staged command and publish it when complete
+ * @param file Per-file state of the writing file
+ * @param kbuf Kernel buffer holding the data
+ * @param count Number of bytes in kbuf
+ * @param nonblock Caller asked for non-blocking I/O
+ * @return count on success, negative error code on failure
+ *
+ * Common tail of aesd_write() and aesd_write_iter(). Each open file stages
+ * its own partial command under its own write_lock, so writers on different
+ * files neither interleave nor contend; dev->lock is taken only to publish
+ * a completed command into the circular buffer. In LZ4 mode the command is
+ * compressed before that, with the file's own LZ4 state.
+ *
+ * When the pending command would exceed dev->max_pending the write is
+ * refused whole: -EAGAIN for non-blocking callers, since another writer on
+ * the same file may still complete the pending command, -ENOSPC otherwise.
+ *
+ * In lossless mode a write that completes a command first sleeps on
+ * dev->space_wq until the commands it would evict have been read by every
+ * consumer, or fails with -EAGAIN for non-blocking callers. A write that
+ * fails after staging its data takes the data back out.
+ */
+static ssize_t aesd_write_kbuf(struct aesd_file *file, const char *kbuf, size_t count, bool nonblock)
+{
+    struct aesd_dev *dev = file->dev;
+    uint32_t stored_size = 0;
+    u64 lock_wait_ns = 0;
+    char *packed = NULL;
+    ssize_t result;
+
+    if (mutex_lock_interruptible(&file->write_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    /* Stage the data in the file's own buffer, no device lock needed */
+    result = aesd_adopt_orphan(file);
+    if (!result)
+    {
+        result = aesd_handle_write_buffer(file, kbuf, count);
+    }
+    if (result == -ENOSPC && nonblock)
+    {
+        result = -EAGAIN;
+    }
+    if (result < 0)
+    {
+        goto out;
+    }
+
+    /* Staged data never holds a newline, so only this write can complete a command */
+    if (!memchr(kbuf, '\n', count))
+    {
+        result = count;
+        goto out;
+    }
+
+    /* Compress outside dev->lock; the lock only covers eviction and publishing */
+    packed = aesd_compress_command(file, file->write_buf, file->write_buf_size, &stored_size);
+
+    if (aesd_dev_lock(dev))
+    {
+        result = -ERESTARTSYS;
+        goto out_unstage;
+    }
+    lock_wait_ns = dev->lock_wait_ns;
+
+    /* Lossless mode: wait until publishing this command evicts only read data */
+    while (dev->lossless && !aesd_lossless_has_room(dev, packed ? stored_size : file->write_buf_size))
+    {
+        u64 gen = dev->space_gen;
+
+        this_cpu_inc(dev->stats->lossless_waits);
+        aesd_dev_unlock(dev);
+        if (nonblock)
+        {
+            result = -EAGAIN;
+            goto out_unstage;
+        }
+
+        if (wait_event_interruptible(dev->space_wq, READ_ONCE(dev->space_gen) != gen) || aesd_dev_lock(dev))
+        {
+            result = -ERESTARTSYS;
+            goto out_unstage;
+        }
+        lock_wait_ns += dev->lock_wait_ns;
+    }
+
+    /* Complete command detected - move to circular buffer */
+    aesd_handle_complete_command(file, packed, stored_size);
+    aesd_dev_unlock(dev);
+    result = count;
+    goto out;
+
+out_unstage:
+    kfree(packed);
+    file->write_buf_size -= count;
+    file->write_buf[file->write_buf_size] = '\0';
+    atomic_long_sub(count, &dev->pending_bytes);
+out:
+    if (result > 0)
+    {
+        this_cpu_inc(dev->stats->writes);
+        this_cpu_add(dev->stats->bytes_written, count);
+    }
+    trace_aesd_write(MINOR(dev->cdev.dev), count, file->write_buf_size, result, lock_wait_ns);
+    mutex_unlock(&file->write_lock);
+    return result;
+}
+
 /**
  * @brief Write operation for the AESD character device
  * @param filp Pointer to the file structure
@@ -319,8 +1077,8 @@ long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
  * 4. When a complete command is detected, moves it to the circular buffer
  *
  * The function is thread-safe and uses mutex locking. Write data is accumulated
- * in a temporary buffer until a newline is encountered, at which point the
- * complete command is added to the circular buffer for later reading.
+ * in the file's own staging buffer until a newline is encountered, at which
+ * point the complete command is added to the circular buffer for later reading.
  *
  * Return values:
  * - Positive: Number of bytes successfully written (always equals input count)
@@ -328,14 +1086,14 @@ long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
  * - -ERESTARTSYS: Interrupted by signal while waiting for mutex
  * - -ENOMEM: Memory allocation failure
  * - -EFAULT: Failed to copy data from user space
+ * - -ENOSPC: The pending command would exceed max_pending
+ * - -EAGAIN: As -ENOSPC, for a file opened with O_NONBLOCK
  */
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos)
+static ssize_t __aesd_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos)
 {
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(filp);
     char *tmp_buf;
-    const char *newline;
-    ssize_t retval = -ENOMEM;
-    int result;
+    ssize_t retval;
 
     /* Input validation */
     if (!dev || !buf || !count)
@@ -343,50 +1101,181 @@ ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count, loff
         return -EINVAL;
     }
 
-    /* Acquire mutex for thread-safe operation */
-    if (mutex_lock_interruptible(&dev->lock))
+    retval = aesd_write_check_size(dev, count);
+    if (retval)
     {
-        return -ERESTARTSYS;
+        return retval;
     }
 
     /* Allocate temporary buffer for copying from user space */
     tmp_buf = kmalloc(count, GFP_KERNEL);
     if (!tmp_buf)
     {
-        mutex_unlock(&dev->lock);
         return -ENOMEM;
     }
 
-    /* Copy data from user space to kernel space */
+    /* Copy data from user space to kernel space before taking the lock */
     if (copy_from_user(tmp_buf, buf, count))
     {
         retval = -EFAULT;
         goto out_free;
     }
 
-    /* Add new data to the device's write buffer */
-    result = aesd_handle_write_buffer(dev, tmp_buf, count);
-    if (result < 0)
+    retval = aesd_write_kbuf(filp->private_data, tmp_buf, count, filp->f_flags & O_NONBLOCK);
+
+out_free:
+    kfree(tmp_buf);
+    return retval;
+}
+
+/**
+ * @brief write() entry point, records the call in the aesd_write latency histogram
+ * @param filp Pointer to the file structure
+ * @param buf User space buffer containing data to write
+ * @param count Number of bytes to write
+ * @param f_pos Pointer to file position (not used in this implementation)
+ * @return Result of __aesd_write()
+ */
+ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos)
+{
+    u64 start = ktime_get_ns();
+    ssize_t retval = __aesd_write(filp, buf, count, f_pos);
+
+    aesd_stats_latency(aesd_file_dev(filp), AESD_LAT_WRITE, start);
+    return retval;
+}
+
+/**
+ * @brief Vectored read for the AESD character device
+ * @param iocb Kernel I/O control block, ki_pos holds the file position
+ * @param to Destination iterator (user iovec, pipe, bvec, ...)
+ * @return Number of bytes read on success, negative error code on failure
+ *
+ * Unlike aesd_read(), which returns at most one command per call, this fills
+ * the whole iterator by walking consecutive entries under a single lock
+ * hold. It backs readv() and, through .splice_read, splice() and sendfile()
+ * from the device into a pipe or socket without a userspace bounce buffer.
+ */
+ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct aesd_file *file = iocb->ki_filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(iocb->ki_filp);
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset = 0;
+    size_t first_offset;
+    size_t count = iov_iter_count(to);
+    uint32_t remaining;
+    ssize_t copied = 0;
+    int err = 0;
+    int first;
+
+    if (!dev)
     {
-        retval = result;
-        goto out_free;
+        return -EINVAL;
+    }
+
+    if (aesd_dev_lock(dev))
+    {
+        return -ERESTARTSYS;
+    }
+
+    aesd_consumer_load(file, &iocb->ki_pos);
+    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, iocb->ki_pos, &entry_offset);
+    first = entry ? (int)aesd_circular_buffer_entry_index(&dev->buffer, entry) : -1;
+    first_offset = entry_offset;
+
+    /* Entries from the one found up to the newest, in order */
+    remaining = entry ? aesd_circular_buffer_count(&dev->buffer) - first : 0;
+
+    while (remaining && iov_iter_count(to))
+    {
+        const char *data = aesd_entry_data(dev, entry);
+        size_t chunk = min(iov_iter_count(to), entry->size - entry_offset);
+        size_t done;
+
+        if (!data)
+        {
+            err = -EIO;
+            break;
+        }
+
+        done = copy_to_iter(data + entry_offset, chunk, to);
+        copied += done;
+        if (done < chunk)
+        {
+            break;
+        }
+
+        entry_offset = 0;
+        remaining--;
+        entry = &dev->buffer.entry[(entry - dev->buffer.entry + 1) % dev->buffer.capacity];
     }
 
-    /* Check if we have a complete command (terminated by newline) */
-    newline = memchr(dev->write_buf, '\n', dev->write_buf_size);
-    if (newline)
+    if (copied)
     {
-        /* Complete command detected - move to circular buffer */
-        aesd_handle_complete_command(dev);
+        iocb->ki_pos += copied;
+        aesd_consumer_store(file, iocb->ki_pos);
+        this_cpu_inc(dev->stats->reads);
+        this_cpu_add(dev->stats->bytes_read, copied);
+    }
+    else if (err || (count && remaining))
+    {
+        /* Data was available but could not be decompressed or copied out; a
+         * zero-length read never got that far and returns 0 */
+        copied = err ? err : -EFAULT;
+    }
+
+    trace_aesd_read(MINOR(dev->cdev.dev), iocb->ki_pos - (copied > 0 ? copied : 0), count, first, first_offset,
+                    copied, dev->lock_wait_ns);
+    aesd_dev_unlock(dev);
+    return copied;
+}
+
+/**
+ * @brief Vectored write for the AESD character device
+ * @param iocb Kernel I/O control block
+ * @param from Source iterator holding the data to write
+ * @return Number of bytes written on success, negative error code on failure
+ *
+ * Gathers the iterator into one kernel buffer and hands it to the same
+ * command assembly as aesd_write(), so writev() of a split line produces a
+ * single command. Also serves splice() into the device.
+ */
+ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct aesd_dev *dev = aesd_file_dev(iocb->ki_filp);
+    size_t count = iov_iter_count(from);
+    char *tmp_buf;
+    ssize_t retval;
+
+    if (!dev || !count)
+    {
+        return dev ? 0 : -EINVAL;
+    }
+
+    retval = aesd_write_check_size(dev, count);
+    if (retval)
+    {
+        return retval;
+    }
+
+    tmp_buf = kmalloc(count, GFP_KERNEL);
+    if (!tmp_buf)
+    {
+        return -ENOMEM;
+    }
+
+    if (copy_from_iter(tmp_buf, count, from) != count)
+    {
+        retval = -EFAULT;
+        goto out_free;
     }
 
-    /* Return number of bytes successfully processed */
-    retval = count;
+    retval = aesd_write_kbuf(iocb->ki_filp->private_data, tmp_buf, count,
+                             (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK));
 
 out_free:
-    /* Cleanup and release resources */
     kfree(tmp_buf);
-    mutex_unlock(&dev->lock);
     return retval;
 }
 
@@ -404,16 +1293,27 @@ out_free:
  * - release: Handles close() system calls - cleanup operations
  * - llseek: Handles lseek() system calls - positioning within buffer data
  * - unlocked_ioctl: Handles ioctl() system calls - advanced seek operations
+ * - read_iter/write_iter: Handle readv()/writev() and back the splice paths
+ * - splice_read/splice_write: Move data between the device and pipes, which
+ *   is what sendfile() to a socket uses
  *
  * The combination of these operations provides a complete character device
  * interface that applications can use with standard POSIX file operations.
  */
 struct file_operations aesd_fops = {
-    .owner = THIS_MODULE,                  /* Prevent module unload while device is open */
-    .read = aesd_read,                     /* Read data from circular buffer */
-    .write = aesd_write,                   /* Write data to device (accumulate until newline) */
-    .open = aesd_open,                     /* Open device - setup file context */
-    .release = aesd_release,               /* Close device - cleanup operations */
-    .llseek = aesd_llseek,                 /* Seek within buffer data */
-    .unlocked_ioctl = aesd_unlocked_ioctl, /* Advanced ioctl operations */
+    .owner = THIS_MODULE,                   /* Prevent module unload while device is open */
+    .read = aesd_read,                      /* Read data from circular buffer */
+    .write = aesd_write,                    /* Write data to device (accumulate until newline) */
+    .open = aesd_open,                      /* Open device - setup file context */
+    .release = aesd_release,                /* Close device - cleanup operations */
+    .llseek = aesd_llseek,                  /* Seek within buffer data */
+    .unlocked_ioctl = aesd_unlocked_ioctl,  /* Advanced ioctl operations */
+    .read_iter = aesd_read_iter,            /* readv() and splice source */
+    .write_iter = aesd_write_iter,          /* writev() and splice sink */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read = copy_splice_read,        /* Device to pipe through read_iter */
+#else
+    .splice_read = generic_file_splice_read, /* Device to pipe through read_iter */
+#endif
+    .splice_write = iter_file_splice_write, /* Pipe to device through write_iter */
 };
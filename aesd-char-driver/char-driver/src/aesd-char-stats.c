@@ -0,0 +1,271 @@
+/**
+ * @file aesd-char-stats.c
+ * @brief Statistics and debugfs support for AESD character driver
+ *
+ * This file implements the observability side of the driver:
+ * - Allocation and summing of the per-CPU counters of each device
+ * - log2 latency histograms for read, write and llseek
+ * - debugfs files exposing the counters, lock timings and buffer state
+ * - The tracepoint instances declared in aesd-char-trace.h
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define __KERNEL__
+#include "../include/aesdchar.h"
+
+/* Instantiate the tracepoints, only in this file */
+#define CREATE_TRACE_POINTS
+#include "../include/aesd-char-trace.h"
+
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+
+/** @brief Top-level debugfs directory, /sys/kernel/debug/aesdchar */
+static struct dentry *aesd_debugfs_root;
+
+/** @brief Histogram names, indexed by enum aesd_lat_op */
+static const char *const aesd_lat_names[AESD_LAT_NR_OPS] = {
+    [AESD_LAT_READ] = "aesd_read",
+    [AESD_LAT_WRITE] = "aesd_write",
+    [AESD_LAT_LLSEEK] = "aesd_llseek",
+};
+
+/**
+ * @brief Allocate the per-CPU counters of a device
+ * @param dev Pointer to the AESD device structure
+ * @return 0 on success, -ENOMEM on failure
+ *
+ * alloc_percpu() returns zeroed memory, so no further setup is needed.
+ */
+int aesd_stats_init(struct aesd_dev *dev)
+{
+    dev->stats = alloc_percpu(struct aesd_pcpu_stats);
+    return dev->stats ? 0 : -ENOMEM;
+}
+
+/**
+ * @brief Free the per-CPU counters of a device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_stats_free(struct aesd_dev *dev)
+{
+    free_percpu(dev->stats);
+    dev->stats = NULL;
+}
+
+/**
+ * @brief Sum the per-CPU counters of a device into one structure
+ * @param dev Pointer to the AESD device structure
+ * @param sum Output, overwritten with the totals
+ *
+ * The per-CPU copies are read without synchronization, so a sum taken while
+ * the device is busy may be a few operations behind; each counter on its
+ * own is never torn on 64-bit targets.
+ */
+void aesd_stats_sum(struct aesd_dev *dev, struct aesd_pcpu_stats *sum)
+{
+    int cpu;
+    int op;
+    int bucket;
+
+    memset(sum, 0, sizeof(*sum));
+    if (!dev->stats)
+    {
+        return;
+    }
+
+    for_each_possible_cpu(cpu)
+    {
+        const struct aesd_pcpu_stats *pcpu = per_cpu_ptr(dev->stats, cpu);
+
+        sum->writes += pcpu->writes;
+        sum->reads += pcpu->reads;
+        sum->ioctls += pcpu->ioctls;
+        sum->bytes_written += pcpu->bytes_written;
+        sum->bytes_read += pcpu->bytes_read;
+        sum->evictions += pcpu->evictions;
+        sum->pending_rejects += pcpu->pending_rejects;
+        sum->lossless_waits += pcpu->lossless_waits;
+        sum->lz4_cache_hits += pcpu->lz4_cache_hits;
+        sum->lz4_cache_misses += pcpu->lz4_cache_misses;
+        sum->lock_acquired += pcpu->lock_acquired;
+        sum->lock_wait_ns += pcpu->lock_wait_ns;
+        sum->lock_hold_ns += pcpu->lock_hold_ns;
+        for (op = 0; op < AESD_LAT_NR_OPS; op++)
+        {
+            for (bucket = 0; bucket < AESD_LAT_BUCKETS; bucket++)
+            {
+                sum->latency[op][bucket] += pcpu->latency[op][bucket];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Record the latency of one call in the local CPU's histogram
+ * @param dev Pointer to the AESD device structure
+ * @param op Which histogram to update
+ * @param start_ns ktime_get_ns() value taken when the call started
+ */
+void aesd_stats_latency(struct aesd_dev *dev, enum aesd_lat_op op, u64 start_ns)
+{
+    if (!dev || !dev->stats)
+    {
+        return;
+    }
+
+    this_cpu_inc(dev->stats->latency[op][aesd_lat_bucket(ktime_get_ns() - start_ns)]);
+}
+
+/**
+ * @brief debugfs "stats" file: counters, lock timings and buffer state
+ * @param s seq_file to print into
+ * @param unused Unused
+ * @return 0
+ */
+static int aesd_stats_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_pcpu_stats sum;
+    size_t bytes_held;
+    size_t bytes_stored;
+    size_t pending;
+    size_t pending_alloc;
+    uint32_t entries;
+    uint32_t capacity;
+    unsigned int consumers = 0;
+    struct aesd_file *file;
+
+    aesd_stats_sum(dev, &sum);
+
+    /* Plain mutex_lock so reading the stats does not skew the lock timings */
+    mutex_lock(&dev->lock);
+    bytes_held = dev->buffer.total_size;
+    bytes_stored = dev->stored_bytes;
+    entries = aesd_circular_buffer_count(&dev->buffer);
+    capacity = dev->max_entries;
+    list_for_each_entry(file, &dev->consumers, consumer_node)
+    {
+        consumers++;
+    }
+    mutex_unlock(&dev->lock);
+    pending = atomic_long_read(&dev->pending_bytes);
+    pending_alloc = atomic_long_read(&dev->pending_alloc);
+
+    seq_printf(s, "writes:          %llu\n", sum.writes);
+    seq_printf(s, "bytes_written:   %llu\n", sum.bytes_written);
+    seq_printf(s, "reads:           %llu\n", sum.reads);
+    seq_printf(s, "bytes_read:      %llu\n", sum.bytes_read);
+    seq_printf(s, "ioctls:          %llu\n", sum.ioctls);
+    seq_printf(s, "evictions:       %llu\n", sum.evictions);
+    seq_printf(s, "entries:         %u/%u\n", entries, capacity);
+    seq_printf(s, "bytes_held:      %zu\n", bytes_held);
+    seq_printf(s, "bytes_stored:    %zu\n", bytes_stored);
+    seq_printf(s, "max_bytes:       %zu\n", dev->max_bytes);
+    seq_printf(s, "pending_bytes:   %zu\n", pending);
+    seq_printf(s, "pending_alloc:   %zu\n", pending_alloc);
+    seq_printf(s, "max_pending:     %zu\n", dev->max_pending);
+    seq_printf(s, "pending_rejects: %llu\n", sum.pending_rejects);
+    if (dev->lossless)
+    {
+        seq_printf(s, "consumers:       %u\n", consumers);
+        seq_printf(s, "lossless_waits:  %llu\n", sum.lossless_waits);
+    }
+    if (dev->compress)
+    {
+        seq_printf(s, "lz4_cache_hits:  %llu\n", sum.lz4_cache_hits);
+        seq_printf(s, "lz4_cache_miss:  %llu\n", sum.lz4_cache_misses);
+    }
+    seq_printf(s, "lock_acquired:   %llu\n", sum.lock_acquired);
+    seq_printf(s, "lock_wait_ns:    %llu\n", sum.lock_wait_ns);
+    seq_printf(s, "lock_hold_ns:    %llu\n", sum.lock_hold_ns);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_stats);
+
+/**
+ * @brief debugfs "latency" file: one log2 histogram per operation
+ * @param s seq_file to print into
+ * @param unused Unused
+ * @return 0
+ *
+ * Only non-empty buckets are printed, as "[low, high) ns: count".
+ */
+static int aesd_latency_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_pcpu_stats sum;
+    int op;
+    int bucket;
+
+    aesd_stats_sum(dev, &sum);
+
+    for (op = 0; op < AESD_LAT_NR_OPS; op++)
+    {
+        seq_printf(s, "%s:\n", aesd_lat_names[op]);
+        for (bucket = 0; bucket < AESD_LAT_BUCKETS; bucket++)
+        {
+            u64 low = bucket ? 1ULL << (bucket - 1) : 0;
+            u64 high = 1ULL << bucket;
+
+            if (!sum.latency[op][bucket])
+            {
+                continue;
+            }
+            if (bucket == AESD_LAT_BUCKETS - 1)
+            {
+                seq_printf(s, "  [%llu, inf) ns: %llu\n", low, sum.latency[op][bucket]);
+            }
+            else
+            {
+                seq_printf(s, "  [%llu, %llu) ns: %llu\n", low, high, sum.latency[op][bucket]);
+            }
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_latency);
+
+/**
+ * @brief Create the top-level aesdchar debugfs directory
+ *
+ * Failures are not fatal: without CONFIG_DEBUG_FS the debugfs calls are
+ * stubs and the driver simply runs without the files.
+ */
+void aesd_debugfs_init(void)
+{
+    aesd_debugfs_root = debugfs_create_dir("aesdchar", NULL);
+}
+
+/**
+ * @brief Create the debugfs files of one device
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_debugfs_add_device(struct aesd_dev *dev)
+{
+    char name[16];
+
+    snprintf(name, sizeof(name), "aesdchar%u", dev->index);
+    dev->debugfs_dir = debugfs_create_dir(name, aesd_debugfs_root);
+    debugfs_create_file("stats", 0444, dev->debugfs_dir, dev, &aesd_stats_fops);
+    debugfs_create_file("latency", 0444, dev->debugfs_dir, dev, &aesd_latency_fops);
+}
+
+/**
+ * @brief Remove the aesdchar debugfs tree and every device's files
+ *
+ * Must run before the devices are freed, since the files point at them.
+ */
+void aesd_debugfs_exit(void)
+{
+    debugfs_remove_recursive(aesd_debugfs_root);
+    aesd_debugfs_root = NULL;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file aesd-char-sysfs.c
+ * @brief sysfs class and attributes for AESD character driver
+ *
+ * Every instance gets a class device, /sys/class/aesdchar/aesdcharN, whose
+ * attributes tune the device while it runs:
+ * - capacity: number of commands held; writing it resizes the ring through
+ *   aesd_resize_device(), keeping the newest commands
+ *
+ * The class device also lets udev create /dev/aesdcharN. As with debugfs,
+ * failures are logged but not fatal; AESDCHAR_IOCRESIZE still works.
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define __KERNEL__
+#include "../include/aesdchar.h"
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sysfs.h>
+#include <linux/version.h>
+
+/** @brief The aesdchar device class, NULL if it could not be created */
+static struct class *aesd_class;
+
+/**
+ * @brief sysfs "capacity" read: current number of command slots
+ * @param d Class device
+ * @param attr Attribute being read
+ * @param buf Page-sized output buffer
+ * @return Number of bytes written to buf
+ */
+static ssize_t capacity_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct aesd_dev *dev = dev_get_drvdata(d);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(dev->max_entries));
+}
+
+/**
+ * @brief sysfs "capacity" write: resize the ring
+ * @param d Class device
+ * @param attr Attribute being written
+ * @param buf New capacity as a decimal or 0x-prefixed number
+ * @param count Length of buf
+ * @return count on success, negative error code on failure
+ */
+static ssize_t capacity_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct aesd_dev *dev = dev_get_drvdata(d);
+    u32 max_entries;
+    int result;
+
+    result = kstrtou32(buf, 0, &max_entries);
+    if (result)
+    {
+        return result;
+    }
+
+    result = aesd_resize_device(dev, max_entries);
+    return result ? result : count;
+}
+static DEVICE_ATTR_RW(capacity);
+
+static struct attribute *aesd_attrs[] = {
+    &dev_attr_capacity.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(aesd);
+
+/**
+ * @brief Create the aesdchar device class
+ */
+void aesd_sysfs_init(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    aesd_class = class_create("aesdchar");
+#else
+    aesd_class = class_create(THIS_MODULE, "aesdchar");
+#endif
+    if (IS_ERR(aesd_class))
+    {
+        pr_warn("aesdchar: class_create failed (%ld), no sysfs attributes\n", PTR_ERR(aesd_class));
+        aesd_class = NULL;
+    }
+}
+
+/**
+ * @brief Destroy the aesdchar device class
+ */
+void aesd_sysfs_exit(void)
+{
+    if (aesd_class)
+    {
+        class_destroy(aesd_class);
+        aesd_class = NULL;
+    }
+}
+
+/**
+ * @brief Create the class device of an instance, with its attributes
+ * @param dev Pointer to the AESD device structure, cdev already added
+ */
+void aesd_sysfs_add_device(struct aesd_dev *dev)
+{
+    struct device *d;
+
+    if (!aesd_class)
+    {
+        return;
+    }
+
+    d = device_create_with_groups(aesd_class, NULL, dev->cdev.dev, dev, aesd_groups, "aesdchar%u", dev->index);
+    if (IS_ERR(d))
+    {
+        pr_warn("aesdchar%u: device_create failed (%ld)\n", dev->index, PTR_ERR(d));
+        return;
+    }
+    dev->sysfs_dev = d;
+}
+
+/**
+ * @brief Remove the class device of an instance
+ * @param dev Pointer to the AESD device structure
+ */
+void aesd_sysfs_remove_device(struct aesd_dev *dev)
+{
+    if (dev->sysfs_dev)
+    {
+        device_destroy(aesd_class, dev->cdev.dev);
+        dev->sysfs_dev = NULL;
+    }
+}
@@ -35,22 +35,36 @@ struct aesd_buffer_entry
 struct aesd_circular_buffer
 {
     /**
-     * An array of pointers to memory allocated for the most recent write operations
+     * An array of `capacity` entries holding the most recent write operations.
+     * Points at default_entry unless storage was supplied through
+     * aesd_circular_buffer_init_storage().
      */
-    struct aesd_buffer_entry entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    struct aesd_buffer_entry *entry;
+    /**
+     * Number of slots available in entry
+     */
+    uint32_t capacity;
     /**
      * The current location in the entry structure where the next write should
      * be stored.
      */
-    uint8_t in_offs;
+    uint32_t in_offs;
     /**
      * The first location in the entry structure to read from
      */
-    uint8_t out_offs;
+    uint32_t out_offs;
     /**
      * set to true when the buffer entry structure is full
      */
     bool full;
+    /**
+     * Sum of the sizes of all valid entries, kept up to date by add/remove
+     */
+    size_t total_size;
+    /**
+     * Backing storage used by aesd_circular_buffer_init()
+     */
+    struct aesd_buffer_entry default_entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
 };
 
 /**
@@ -99,11 +113,64 @@ extern void aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffe
  */
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+/**
+ * @brief Initialize a circular buffer on caller-provided entry storage
+ * @param buffer The circular buffer structure to initialize
+ * @param storage Array of at least @p capacity entries, owned by the caller
+ * @param capacity Number of entries the buffer can hold before overwriting
+ *
+ * Behaves like aesd_circular_buffer_init() but lets the caller choose the
+ * number of slots, e.g. from a module parameter. The storage is cleared.
+ */
+extern void aesd_circular_buffer_init_storage(struct aesd_circular_buffer *buffer, struct aesd_buffer_entry *storage,
+                                              uint32_t capacity);
+
+/**
+ * @brief Number of valid entries currently held in the circular buffer
+ * @param buffer The circular buffer to inspect
+ * @return Entry count, between 0 and buffer->capacity
+ */
+static inline uint32_t aesd_circular_buffer_count(const struct aesd_circular_buffer *buffer)
+{
+    if (buffer->full)
+    {
+        return buffer->capacity;
+    }
+    if (buffer->in_offs >= buffer->out_offs)
+    {
+        return buffer->in_offs - buffer->out_offs;
+    }
+    return buffer->capacity - buffer->out_offs + buffer->in_offs;
+}
+
+/**
+ * @brief Return the n-th valid entry counting from the oldest one
+ * @param buffer The circular buffer to index
+ * @param n Zero-referenced command index, must be below aesd_circular_buffer_count()
+ * @return Pointer to the entry slot
+ */
+static inline struct aesd_buffer_entry *aesd_circular_buffer_entry_at(struct aesd_circular_buffer *buffer, uint32_t n)
+{
+    return &buffer->entry[(buffer->out_offs + n) % buffer->capacity];
+}
+
+/**
+ * @brief Command index of an entry slot, the inverse of aesd_circular_buffer_entry_at()
+ * @param buffer The circular buffer the entry belongs to
+ * @param entry Pointer into buffer->entry
+ * @return Zero-referenced command index, 0 being the oldest entry
+ */
+static inline uint32_t aesd_circular_buffer_entry_index(const struct aesd_circular_buffer *buffer,
+                                                        const struct aesd_buffer_entry *entry)
+{
+    return ((uint32_t)(entry - buffer->entry) + buffer->capacity - buffer->out_offs) % buffer->capacity;
+}
+
 /**
  * @brief Macro to iterate over all entries in the circular buffer
  * @param entryptr A struct aesd_buffer_entry* that will be set to each entry
  * @param buffer The struct aesd_circular_buffer* describing the buffer
- * @param index A uint8_t stack allocated variable used as loop index
+ * @param index A uint32_t stack allocated variable used as loop index
  *
  * This macro creates a for loop to iterate over each member of the circular buffer.
  * It is particularly useful when you've allocated memory for circular buffer entries
@@ -115,7 +182,7 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
  *
  * Example usage:
  * @code
- * uint8_t index;
+ * uint32_t index;
  * struct aesd_circular_buffer buffer;
  * struct aesd_buffer_entry *entry;
  * AESD_CIRCULAR_BUFFER_FOREACH(entry, &buffer, index) {
@@ -126,7 +193,7 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
  * @endcode
  */
 #define AESD_CIRCULAR_BUFFER_FOREACH(entryptr, buffer, index)                                                          \
-    for (index = 0, entryptr = &((buffer)->entry[index]); index < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;             \
+    for (index = 0, entryptr = &((buffer)->entry[index]); index < (buffer)->capacity;                                  \
          index++, entryptr = &((buffer)->entry[index]))
 
 
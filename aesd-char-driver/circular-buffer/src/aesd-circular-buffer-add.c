@@ -32,29 +32,36 @@
 void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
     /* Input validation */
-    if (!buffer || !add_entry || !add_entry->buffptr)
+    if (!buffer || !add_entry || !add_entry->buffptr || !buffer->capacity)
     {
         DEBUG_LOG("Invalid parameters in add_entry\n");
         return;
     }
 
-    DEBUG_LOG("Adding entry of size %zu at position %d\n", add_entry->size, buffer->in_offs);
+    DEBUG_LOG("Adding entry of size %zu at position %u\n", add_entry->size, buffer->in_offs);
+
+    /* Handle buffer overflow - drop the overwritten entry from the running total */
+    if (buffer->full)
+    {
+        buffer->total_size -= buffer->entry[buffer->in_offs].size;
+    }
 
     /* Copy the entry to the current input position */
     buffer->entry[buffer->in_offs] = *add_entry;
+    buffer->total_size += add_entry->size;
 
     /* Handle buffer overflow - advance output position if buffer is full */
     if (buffer->full)
     {
-        DEBUG_LOG("Buffer full, advancing out_offs from %d\n", buffer->out_offs);
-        buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        DEBUG_LOG("Buffer full, advancing out_offs from %u\n", buffer->out_offs);
+        buffer->out_offs = (buffer->out_offs + 1) % buffer->capacity;
     }
 
     /* Advance input position with wrap-around */
-    buffer->in_offs = (buffer->in_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    buffer->in_offs = (buffer->in_offs + 1) % buffer->capacity;
 
     /* Update full flag - buffer is full when input catches up to output */
     buffer->full = (buffer->in_offs == buffer->out_offs);
 
-    DEBUG_LOG("Buffer state after add: in=%d, out=%d, full=%d\n", buffer->in_offs, buffer->out_offs, buffer->full);
+    DEBUG_LOG("Buffer state after add: in=%u, out=%u, full=%d\n", buffer->in_offs, buffer->out_offs, buffer->full);
 }
@@ -69,28 +69,21 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
     }
 
     size_t current_pos = 0;                 // Running total of characters processed
-    uint8_t current_idx = buffer->out_offs; // Start from oldest entry
-    uint8_t entries_checked = 0;            // Counter for loop termination
-    uint8_t total_entries;                  // Total valid entries to search
+    uint32_t current_idx = buffer->out_offs; // Start from oldest entry
+    uint32_t entries_checked = 0;            // Counter for loop termination
+    uint32_t total_entries;                  // Total valid entries to search
 
-    // Calculate total valid entries based on buffer state
-    if (buffer->full)
-    {
-        // All entries are valid when buffer is full
-        total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-    }
-    else if (buffer->in_offs >= buffer->out_offs)
-    {
-        // Simple case: no wraparound, entries are contiguous
-        total_entries = buffer->in_offs - buffer->out_offs;
-    }
-    else
+    // Calculate total valid entries based on buffer state (full, contiguous or wrapped)
+    total_entries = aesd_circular_buffer_count(buffer);
+
+    // Offsets past the running total cannot be in the buffer
+    if (char_offset >= buffer->total_size)
     {
-        // Wraparound case: entries span from out_offs to end, then 0 to in_offs
-        total_entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs + buffer->in_offs;
+        DEBUG_LOG("Offset %zu beyond buffer size %zu\n", char_offset, buffer->total_size);
+        return NULL;
     }
 
-    DEBUG_LOG("Searching for offset %zu in %d entries\n", char_offset, total_entries);
+    DEBUG_LOG("Searching for offset %zu in %u entries\n", char_offset, total_entries);
 
     // Search through valid entries in chronological order (oldest to newest)
     while (entries_checked < total_entries)
@@ -105,13 +98,13 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
             // Calculate relative offset within this entry
             *entry_offset_byte_rtn = char_offset - current_pos;
 
-            DEBUG_LOG("Found offset in entry %d at relative offset %zu\n", current_idx, *entry_offset_byte_rtn);
+            DEBUG_LOG("Found offset in entry %u at relative offset %zu\n", current_idx, *entry_offset_byte_rtn);
             return &buffer->entry[current_idx];
         }
 
         // Move to next entry: update position and advance index with wraparound
         current_pos += entry_size;
-        current_idx = (current_idx + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        current_idx = (current_idx + 1) % buffer->capacity;
         entries_checked++;
     }
 
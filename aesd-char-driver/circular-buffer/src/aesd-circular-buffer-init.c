@@ -40,6 +40,8 @@
  * @note This function is safe to call multiple times on the same buffer
  * @note After initialization, the buffer will be empty (not full)
  * @note Both in_offs and out_offs will be set to 0
+ * @note The buffer uses its embedded default_entry storage with
+ *       AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED slots
  */
 void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
 {
@@ -54,5 +56,39 @@ void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
     // This sets all buffer entries to NULL/0, offsets to 0, and full flag to false
     memset(buffer, 0, sizeof(struct aesd_circular_buffer));
 
+    // Point at the embedded storage so the fixed-size behaviour is unchanged
+    buffer->entry = buffer->default_entry;
+    buffer->capacity = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+
     DEBUG_LOG("Buffer initialized\n");
 }
+
+/**
+ * @brief Initialize a circular buffer on caller-provided entry storage
+ *
+ * Used by the driver when the number of slots is chosen at module load time.
+ * The storage array is cleared and becomes the buffer's entry array; the
+ * embedded default_entry array is left unused.
+ *
+ * @param buffer Pointer to the circular buffer structure to initialize
+ * @param storage Array of at least @p capacity entries, owned by the caller
+ * @param capacity Number of slots, must be non-zero
+ *
+ * @note Falls back to aesd_circular_buffer_init() when storage is NULL or
+ *       capacity is 0
+ */
+void aesd_circular_buffer_init_storage(struct aesd_circular_buffer *buffer, struct aesd_buffer_entry *storage,
+                                       uint32_t capacity)
+{
+    aesd_circular_buffer_init(buffer);
+    if (!buffer || !storage || !capacity)
+    {
+        return;
+    }
+
+    memset(storage, 0, sizeof(struct aesd_buffer_entry) * capacity);
+    buffer->entry = storage;
+    buffer->capacity = capacity;
+
+    DEBUG_LOG("Buffer initialized with %u slots\n", capacity);
+}
@@ -64,19 +64,20 @@ void aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer)
         return;
     }
 
-    DEBUG_LOG("Removing entry at position %d\n", buffer->out_offs);
+    DEBUG_LOG("Removing entry at position %u\n", buffer->out_offs);
 
     // Clear the entry at the current output position
     // Note: This does NOT free the memory, just clears the reference
+    buffer->total_size -= buffer->entry[buffer->out_offs].size;
     buffer->entry[buffer->out_offs].buffptr = NULL;
     buffer->entry[buffer->out_offs].size = 0;
 
     // Advance output offset with wrap-around using modulo arithmetic
     // This ensures we stay within the bounds of the circular buffer
-    buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    buffer->out_offs = (buffer->out_offs + 1) % buffer->capacity;
 
     // Buffer is no longer full after removing an entry
     buffer->full = false;
 
-    DEBUG_LOG("Buffer state after remove: in=%d, out=%d, full=%d\n", buffer->in_offs, buffer->out_offs, buffer->full);
+    DEBUG_LOG("Buffer state after remove: in=%u, out=%u, full=%d\n", buffer->in_offs, buffer->out_offs, buffer->full);
 }
@@ -0,0 +1,531 @@
+/**
+ * @file aesdchar-cuse.c
+ * @brief Userspace (CUSE) implementation of the aesdchar device
+ *
+ * Exposes /dev/aesdchar (or --name=NAME) through CUSE so that aesdsocket,
+ * test_ioctl and load tests can run on hosts where the aesdchar module
+ * cannot be loaded. Commands are stored with the same circular buffer
+ * sources as the driver (circular-buffer/src) and the write path follows
+ * char-driver/src/aesd-char-buffer.c:
+ * - Each open file stages its own partial command under its own lock, so
+ *   writers on different files never interleave bytes within a command
+ * - Only the bytes of a write are scanned for the newline, and the device
+ *   lock is taken only to publish a completed command
+ * - A complete command evicts the oldest one when the buffer is full
+ * - A pending command is bounded by --max-pending, like aesd_max_pending
+ * - A file closed mid-command hands its data to the device, and the next
+ *   write on any file continues it
+ *
+ * Differences from the module, imposed by CUSE:
+ * - The kernel does not forward lseek() to CUSE servers and always passes
+ *   offset 0 to read(), so each open file's position is kept here and can
+ *   only be moved by reading or with AESDCHAR_IOCSEEKTO
+ * - Only AESDCHAR_IOCSEEKTO is supported; GETINFO and SNAPSHOT carry user
+ *   pointers and return -ENOTTY
+ *
+ * Usage: aesdchar-cuse [-f] [-s] [--name=aesdchar] [--entries=10] [--max-pending=1048576]
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define FUSE_USE_VERSION 35
+
+#include "../aesd_ioctl.h"
+#include "../circular-buffer/include/aesd-circular-buffer.h"
+#include <cuse_lowlevel.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse_opt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Default limit on a pending partial command, matches AESD_DEFAULT_MAX_PENDING */
+#define AESD_CUSE_DEFAULT_MAX_PENDING (1024 * 1024)
+
+/**
+ * @brief State of the emulated device, shared by all open files
+ */
+struct aesd_cuse_dev
+{
+    /** @brief Circular buffer for storing complete commands */
+    struct aesd_circular_buffer buffer;
+
+    /** @brief Entry storage backing buffer */
+    struct aesd_buffer_entry *entries;
+
+    /** @brief Maximum bytes of a partial command staged by one file, 0 for no limit */
+    size_t max_pending;
+
+    /** @brief Partial command of a file closed mid-command, continued by the next write */
+    char *orphan_buf;
+
+    /** @brief Current size of data in orphan_buf */
+    size_t orphan_size;
+
+    /** @brief Allocated size of orphan_buf */
+    size_t orphan_alloc;
+
+    /** @brief Protects the buffer and the orphan, the CUSE loop is multi-threaded */
+    pthread_mutex_t lock;
+};
+
+/**
+ * @brief Per-open state, stored in fuse_file_info::fh
+ */
+struct aesd_cuse_file
+{
+    /** @brief Read position in the concatenated commands, protected by the device lock */
+    off_t pos;
+
+    /** @brief Serializes writers sharing this open file, protects write_buf */
+    pthread_mutex_t write_lock;
+
+    /** @brief Partial command staged by this file until its newline arrives */
+    char *write_buf;
+
+    /** @brief Current size of data in write_buf */
+    size_t write_buf_size;
+
+    /** @brief Allocated size of write_buf, grown geometrically */
+    size_t write_buf_alloc;
+};
+
+/**
+ * @brief Command line options
+ */
+struct aesd_cuse_opts
+{
+    /** @brief Device node name under /dev */
+    char *name;
+
+    /** @brief Number of commands held */
+    unsigned int entries;
+
+    /** @brief Limit on a pending partial command */
+    unsigned long max_pending;
+
+    /** @brief Device major number, 0 for dynamic */
+    unsigned int major;
+
+    /** @brief Device minor number */
+    unsigned int minor;
+};
+
+static struct aesd_cuse_dev aesd_cuse_device;
+
+/** @brief fuse_opt entry storing an option into struct aesd_cuse_opts */
+#define AESD_CUSE_OPT(t, p) {t, offsetof(struct aesd_cuse_opts, p), 1}
+
+static const struct fuse_opt aesd_cuse_opt_spec[] = {
+    AESD_CUSE_OPT("--name=%s", name),
+    AESD_CUSE_OPT("--entries=%u", entries),
+    AESD_CUSE_OPT("--max-pending=%lu", max_pending),
+    AESD_CUSE_OPT("--maj=%u", major),
+    AESD_CUSE_OPT("--min=%u", minor),
+    FUSE_OPT_END,
+};
+
+/**
+ * @brief Append write data to a file's staged command
+ * @param dev Pointer to the emulated device
+ * @param file Per-open state, with write_lock held
+ * @param data New data
+ * @param count Number of bytes in data
+ * @return 0 on success, -ENOSPC past max_pending, -ENOMEM on allocation failure
+ *
+ * Mirrors aesd_handle_write_buffer(): exact first allocation, geometric
+ * growth on append, staged data untouched on failure.
+ */
+static int aesd_cuse_append(struct aesd_cuse_dev *dev, struct aesd_cuse_file *file, const char *data, size_t count)
+{
+    size_t new_size = file->write_buf_size + count;
+
+    if (dev->max_pending && new_size > dev->max_pending)
+    {
+        return -ENOSPC;
+    }
+
+    if (new_size + 1 > file->write_buf_alloc)
+    {
+        size_t new_alloc = new_size + 1;
+        char *new_buf;
+
+        if (file->write_buf)
+        {
+            new_alloc = new_alloc > file->write_buf_alloc * 2 ? new_alloc : file->write_buf_alloc * 2;
+            if (dev->max_pending && new_alloc > dev->max_pending + 1)
+            {
+                new_alloc = dev->max_pending + 1;
+            }
+        }
+
+        new_buf = realloc(file->write_buf, new_alloc);
+        if (!new_buf)
+        {
+            return -ENOMEM;
+        }
+        file->write_buf = new_buf;
+        file->write_buf_alloc = new_alloc;
+    }
+
+    memcpy(file->write_buf + file->write_buf_size, data, count);
+    file->write_buf_size = new_size;
+    file->write_buf[new_size] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Continue the device's orphaned partial command in a file
+ * @param dev Pointer to the emulated device
+ * @param file Per-open state, with write_lock held
+ *
+ * Mirrors aesd_adopt_orphan(); the unlocked peek keeps the common case
+ * free of the device lock.
+ */
+static void aesd_cuse_adopt_orphan(struct aesd_cuse_dev *dev, struct aesd_cuse_file *file)
+{
+    if (!__atomic_load_n(&dev->orphan_buf, __ATOMIC_RELAXED) || file->write_buf_size)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    if (dev->orphan_buf)
+    {
+        free(file->write_buf);
+        file->write_buf = dev->orphan_buf;
+        file->write_buf_size = dev->orphan_size;
+        file->write_buf_alloc = dev->orphan_alloc;
+        __atomic_store_n(&dev->orphan_buf, NULL, __ATOMIC_RELAXED);
+        dev->orphan_size = 0;
+        dev->orphan_alloc = 0;
+    }
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * @brief Hand a closing file's partial command over to the device
+ * @param dev Pointer to the emulated device
+ * @param file Per-open state of the file being released
+ *
+ * Mirrors aesd_orphan_partial(): appended to an existing orphan, dropped
+ * when that would exceed max_pending.
+ */
+static void aesd_cuse_orphan_partial(struct aesd_cuse_dev *dev, struct aesd_cuse_file *file)
+{
+    size_t new_size;
+    char *new_buf;
+
+    if (!file->write_buf_size)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    if (!dev->orphan_buf)
+    {
+        __atomic_store_n(&dev->orphan_buf, file->write_buf, __ATOMIC_RELAXED);
+        dev->orphan_size = file->write_buf_size;
+        dev->orphan_alloc = file->write_buf_alloc;
+        file->write_buf = NULL;
+        goto out;
+    }
+
+    new_size = dev->orphan_size + file->write_buf_size;
+    if (dev->max_pending && new_size > dev->max_pending)
+    {
+        goto out;
+    }
+
+    if (new_size + 1 > dev->orphan_alloc)
+    {
+        new_buf = realloc(dev->orphan_buf, new_size + 1);
+        if (!new_buf)
+        {
+            goto out;
+        }
+        __atomic_store_n(&dev->orphan_buf, new_buf, __ATOMIC_RELAXED);
+        dev->orphan_alloc = new_size + 1;
+    }
+    memcpy(dev->orphan_buf + dev->orphan_size, file->write_buf, file->write_buf_size);
+    dev->orphan_size = new_size;
+    dev->orphan_buf[new_size] = '\0';
+
+out:
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * @brief Publish a file's staged command, evicting the oldest when full
+ * @param dev Pointer to the emulated device, with lock held
+ * @param file Per-open state, with write_lock held
+ *
+ * Mirrors aesd_handle_complete_command() without the byte limit and LZ4
+ * storage, which only matter for kernel memory.
+ */
+static void aesd_cuse_complete(struct aesd_cuse_dev *dev, struct aesd_cuse_file *file)
+{
+    struct aesd_buffer_entry entry = {
+        .buffptr = file->write_buf,
+        .size = file->write_buf_size,
+    };
+
+    if (dev->buffer.full)
+    {
+        free((void *)dev->buffer.entry[dev->buffer.out_offs].buffptr);
+        aesd_circular_buffer_remove_entry(&dev->buffer);
+    }
+
+    file->write_buf = NULL;
+    file->write_buf_size = 0;
+    file->write_buf_alloc = 0;
+    aesd_circular_buffer_add_entry(&dev->buffer, &entry);
+}
+
+/**
+ * @brief CUSE open: allocate the per-open state
+ */
+static void aesd_cuse_open(fuse_req_t req, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_file *file = calloc(1, sizeof(*file));
+
+    if (!file)
+    {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    pthread_mutex_init(&file->write_lock, NULL);
+    fi->fh = (uintptr_t)file;
+    fuse_reply_open(req, fi);
+}
+
+/**
+ * @brief CUSE release: hand a partial command to the device, free the per-open state
+ */
+static void aesd_cuse_release(fuse_req_t req, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_file *file = (struct aesd_cuse_file *)(uintptr_t)fi->fh;
+
+    aesd_cuse_orphan_partial(&aesd_cuse_device, file);
+    free(file->write_buf);
+    pthread_mutex_destroy(&file->write_lock);
+    free(file);
+    fuse_reply_err(req, 0);
+}
+
+/**
+ * @brief CUSE read: return up to the rest of the command at the file position
+ *
+ * Like aesd_read(), a single call never crosses a command boundary. off is
+ * ignored because CUSE always passes 0.
+ */
+static void aesd_cuse_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_file *file = (struct aesd_cuse_file *)(uintptr_t)fi->fh;
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset = 0;
+    size_t count = 0;
+    char *out = NULL;
+
+    pthread_mutex_lock(&dev->lock);
+    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, file->pos, &entry_offset);
+    if (entry)
+    {
+        count = entry->size - entry_offset < size ? entry->size - entry_offset : size;
+        out = malloc(count);
+        if (out)
+        {
+            memcpy(out, entry->buffptr + entry_offset, count);
+            file->pos += count;
+        }
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    if (entry && !out)
+    {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    /* Reply outside the lock, it may block on the kernel */
+    fuse_reply_buf(req, out, count);
+    free(out);
+}
+
+/**
+ * @brief CUSE write: stage data in the file, publish the command on a newline
+ *
+ * Staged data never holds a newline, so only the bytes of this write are
+ * scanned. -EAGAIN replaces -ENOSPC for O_NONBLOCK opens, as in the driver.
+ */
+static void aesd_cuse_write(fuse_req_t req, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_file *file = (struct aesd_cuse_file *)(uintptr_t)fi->fh;
+    int result;
+
+    pthread_mutex_lock(&file->write_lock);
+    aesd_cuse_adopt_orphan(dev, file);
+    result = aesd_cuse_append(dev, file, buf, size);
+    if (!result && memchr(buf, '\n', size))
+    {
+        pthread_mutex_lock(&dev->lock);
+        aesd_cuse_complete(dev, file);
+        pthread_mutex_unlock(&dev->lock);
+    }
+    pthread_mutex_unlock(&file->write_lock);
+
+    if (result == -ENOSPC && (fi->flags & O_NONBLOCK))
+    {
+        result = -EAGAIN;
+    }
+
+    if (result)
+    {
+        fuse_reply_err(req, -result);
+    }
+    else
+    {
+        fuse_reply_write(req, size);
+    }
+}
+
+/**
+ * @brief CUSE ioctl: AESDCHAR_IOCSEEKTO on the per-open position
+ *
+ * The command encodes its argument size, so the kernel copies the struct
+ * in ("restricted" ioctl) and no retry round-trip is needed.
+ */
+static void aesd_cuse_ioctl(fuse_req_t req, unsigned int cmd, void *arg, struct fuse_file_info *fi,
+                            unsigned int flags, const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_file *file = (struct aesd_cuse_file *)(uintptr_t)fi->fh;
+    struct aesd_seekto seekto;
+    struct aesd_buffer_entry *entry;
+    off_t pos = 0;
+    uint32_t i;
+    int result = 0;
+
+    if (flags & FUSE_IOCTL_COMPAT)
+    {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+
+    if (cmd != AESDCHAR_IOCSEEKTO)
+    {
+        fuse_reply_err(req, ENOTTY);
+        return;
+    }
+
+    if (in_bufsz < sizeof(seekto))
+    {
+        fuse_reply_err(req, EFAULT);
+        return;
+    }
+    memcpy(&seekto, in_buf, sizeof(seekto));
+
+    pthread_mutex_lock(&dev->lock);
+    if (seekto.write_cmd >= aesd_circular_buffer_count(&dev->buffer))
+    {
+        result = EINVAL;
+        goto out;
+    }
+
+    for (i = 0; i < seekto.write_cmd; i++)
+    {
+        pos += aesd_circular_buffer_entry_at(&dev->buffer, i)->size;
+    }
+
+    entry = aesd_circular_buffer_entry_at(&dev->buffer, seekto.write_cmd);
+    if (seekto.write_cmd_offset >= entry->size)
+    {
+        result = EINVAL;
+        goto out;
+    }
+    file->pos = pos + seekto.write_cmd_offset;
+
+out:
+    pthread_mutex_unlock(&dev->lock);
+    if (result)
+    {
+        fuse_reply_err(req, result);
+    }
+    else
+    {
+        fuse_reply_ioctl(req, 0, NULL, 0);
+    }
+}
+
+static const struct cuse_lowlevel_ops aesd_cuse_ops = {
+    .open = aesd_cuse_open,
+    .read = aesd_cuse_read,
+    .write = aesd_cuse_write,
+    .release = aesd_cuse_release,
+    .ioctl = aesd_cuse_ioctl,
+};
+
+/**
+ * @brief Parse options, set up the device state and run the CUSE loop
+ * @return 0 on clean exit, 1 on error
+ */
+int main(int argc, char **argv)
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_opts opts = {
+        .entries = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+        .max_pending = AESD_CUSE_DEFAULT_MAX_PENDING,
+    };
+    struct cuse_info ci = {0};
+    char dev_name[128];
+    const char *dev_info_argv[] = {dev_name};
+    uint32_t index;
+    struct aesd_buffer_entry *entry;
+    int ret;
+
+    if (fuse_opt_parse(&args, &opts, aesd_cuse_opt_spec, NULL))
+    {
+        fprintf(stderr, "aesdchar-cuse: failed to parse options\n");
+        return 1;
+    }
+
+    if (!opts.entries)
+    {
+        fprintf(stderr, "aesdchar-cuse: --entries must be at least 1\n");
+        return 1;
+    }
+
+    dev->entries = calloc(opts.entries, sizeof(*dev->entries));
+    if (!dev->entries)
+    {
+        return 1;
+    }
+    aesd_circular_buffer_init_storage(&dev->buffer, dev->entries, opts.entries);
+    dev->max_pending = opts.max_pending;
+    pthread_mutex_init(&dev->lock, NULL);
+
+    snprintf(dev_name, sizeof(dev_name), "DEVNAME=%s", opts.name ? opts.name : "aesdchar");
+    ci.dev_major = opts.major;
+    ci.dev_minor = opts.minor;
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = dev_info_argv;
+
+    ret = cuse_lowlevel_main(args.argc, args.argv, &ci, &aesd_cuse_ops, NULL);
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, index)
+    {
+        free((void *)entry->buffptr);
+    }
+    free(dev->orphan_buf);
+    free(dev->entries);
+    free(opts.name);
+    pthread_mutex_destroy(&dev->lock);
+    fuse_opt_free_args(&args);
+    return ret ? 1 : 0;
+}
@@ -6,6 +6,7 @@
  * This file contains the module initialization and cleanup functions for the
  * AESD character driver. It handles:
  * - Dynamic major number allocation
+ * - Module parameters for device count and per-device capacity
  * - Device structure initialization
  * - Character device registration
  * - Module loading and unloading
@@ -21,10 +22,12 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/mutex.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/stringify.h>
 #include <linux/types.h>
 
 /* Module metadata */
@@ -37,11 +40,74 @@ MODULE_VERSION("1.0");
 /** @brief Major device number (dynamically allocated) */
 int aesd_major = 0;
 
-/** @brief Minor device number (always 0 for single device) */
+/** @brief First minor device number, device i uses aesd_minor + i */
 int aesd_minor = 0;
 
-/** @brief Global device structure instance */
-struct aesd_dev aesd_device;
+/** @brief Number of device instances, /dev/aesdchar0 .. /dev/aesdchar<N-1> */
+unsigned int aesd_nr_devs = AESD_NR_DEVS;
+module_param(aesd_nr_devs, uint, 0444);
+MODULE_PARM_DESC(aesd_nr_devs, "Number of aesdchar devices to register (1.." __stringify(AESD_MAX_DEVS) ")");
+
+/** @brief Per-device command capacity, unset or 0 entries use the default */
+static unsigned int aesd_max_entries[AESD_MAX_DEVS];
+static int aesd_max_entries_count;
+module_param_array(aesd_max_entries, uint, &aesd_max_entries_count, 0444);
+MODULE_PARM_DESC(aesd_max_entries, "Commands held per device, comma separated (default "
+                                   __stringify(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) ", at most "
+                                   __stringify(AESD_MAX_ENTRIES) ")");
+
+/** @brief Per-device byte capacity, unset or 0 entries mean no byte limit */
+static unsigned long aesd_max_bytes[AESD_MAX_DEVS];
+static int aesd_max_bytes_count;
+module_param_array(aesd_max_bytes, ulong, &aesd_max_bytes_count, 0444);
+MODULE_PARM_DESC(aesd_max_bytes, "Bytes held per device before evicting, comma separated (default 0 = unlimited)");
+
+/** @brief Per-device limit on a partial command, unset entries use the default */
+static unsigned long aesd_max_pending[AESD_MAX_DEVS];
+static int aesd_max_pending_count;
+module_param_array(aesd_max_pending, ulong, &aesd_max_pending_count, 0444);
+MODULE_PARM_DESC(aesd_max_pending, "Bytes of an unterminated command buffered per device, comma separated (default "
+                                   __stringify(AESD_DEFAULT_MAX_PENDING) ", 0 = unlimited)");
+
+/** @brief Store completed commands LZ4-compressed on every device */
+static bool aesd_lz4;
+module_param(aesd_lz4, bool, 0444);
+MODULE_PARM_DESC(aesd_lz4, "Compress stored commands with LZ4 (default off)");
+
+/** @brief Per-device lossless mode, unset entries keep overwriting the oldest command */
+static bool aesd_lossless[AESD_MAX_DEVS];
+static int aesd_lossless_count;
+module_param_array(aesd_lossless, bool, &aesd_lossless_count, 0444);
+MODULE_PARM_DESC(aesd_lossless, "Block writers until consumers have read the oldest command, comma separated "
+                                "(default N)");
+
+/** @brief Array of aesd_nr_devs device instances */
+struct aesd_dev *aesd_devices;
+
+/**
+ * @brief Tear down the first @p count device instances
+ * @param count Number of instances that were fully set up
+ */
+static void aesd_remove_devices(unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        struct aesd_dev *dev = &aesd_devices[i];
+        struct aesd_pcpu_stats sum;
+
+        aesd_stats_sum(dev, &sum);
+        pr_info("aesdchar%u: %llu writes (%llu bytes), %llu reads (%llu bytes), %llu evictions\n", i, sum.writes,
+                sum.bytes_written, sum.reads, sum.bytes_read, sum.evictions);
+
+        /* Remove the sysfs device and the cdev before freeing its data */
+        aesd_sysfs_remove_device(dev);
+        cdev_del(&dev->cdev);
+        aesd_cleanup_device(dev);
+        mutex_destroy(&dev->lock);
+    }
+}
 
 /**
  * @brief Module initialization function
@@ -49,10 +115,11 @@ struct aesd_dev aesd_device;
  *
  * This function is called when the module is loaded into the kernel.
  * It performs the following operations:
- * 1. Allocates a dynamic major device number
- * 2. Initializes the device structure and mutex
- * 3. Initializes the circular buffer
- * 4. Sets up the character device and registers it with the kernel
+ * 1. Allocates a dynamic major number and aesd_nr_devs minor numbers
+ * 2. Allocates the device array
+ * 3. Initializes each device's mutex, entry storage and circular buffer
+ * 4. Sets up each character device and registers it with the kernel
+ * 5. Creates the debugfs statistics files and sysfs class device of each device
  *
  * If any step fails, it cleans up previously allocated resources.
  */
@@ -60,33 +127,86 @@ static int __init aesd_init(void)
 {
     dev_t dev = 0;
     int result;
+    unsigned int i;
+
+    if (aesd_nr_devs == 0 || aesd_nr_devs > AESD_MAX_DEVS)
+    {
+        pr_err("aesd_nr_devs must be between 1 and %d\n", AESD_MAX_DEVS);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < aesd_nr_devs; i++)
+    {
+        if (aesd_max_entries[i] > AESD_MAX_ENTRIES)
+        {
+            pr_err("aesd_max_entries[%u] must be between 1 and %d, or 0 for the default\n", i, AESD_MAX_ENTRIES);
+            return -EINVAL;
+        }
+    }
 
     /* Step 1: Allocate character device region with dynamic major number */
-    result = alloc_chrdev_region(&dev, aesd_minor, 1, "aesdchar");
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs, "aesdchar");
     if (result < 0)
     {
         pr_err("Could not allocate major number %d\n", aesd_major);
         return result;
     }
     aesd_major = MAJOR(dev);
+    aesd_debugfs_init();
+    aesd_sysfs_init();
 
-    /* Step 2: Initialize device structure and synchronization primitives */
-    memset(&aesd_device, 0, sizeof(struct aesd_dev));
-    mutex_init(&aesd_device.lock);
-    aesd_circular_buffer_init(&aesd_device.buffer);
+    /* Step 2: Allocate one independent state structure per minor */
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (!aesd_devices)
+    {
+        aesd_sysfs_exit();
+        aesd_debugfs_exit();
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
 
-    /* Step 3: Setup character device and add to kernel */
-    result = aesd_setup_cdev(&aesd_device);
-    if (result)
+    for (i = 0; i < aesd_nr_devs; i++)
     {
-        /* Cleanup on failure */
-        unregister_chrdev_region(dev, 1);
-        mutex_destroy(&aesd_device.lock);
-        return result;
+        struct aesd_dev_params params = {
+            .max_entries = aesd_max_entries[i] ? aesd_max_entries[i] : AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+            .max_bytes = aesd_max_bytes[i],
+            .max_pending = i < aesd_max_pending_count ? aesd_max_pending[i] : AESD_DEFAULT_MAX_PENDING,
+            .compress = aesd_lz4,
+            .lossless = aesd_lossless[i],
+        };
+
+        /* Step 3: Initialize device structure and synchronization primitives */
+        result = aesd_init_device(&aesd_devices[i], i, &params);
+        if (result)
+        {
+            goto fail;
+        }
+
+        /* Step 4: Setup character device and add to kernel */
+        result = aesd_setup_cdev(&aesd_devices[i]);
+        if (result)
+        {
+            aesd_cleanup_device(&aesd_devices[i]);
+            mutex_destroy(&aesd_devices[i].lock);
+            goto fail;
+        }
+        aesd_debugfs_add_device(&aesd_devices[i]);
+        aesd_sysfs_add_device(&aesd_devices[i]);
     }
 
-    pr_info("AESD character driver loaded successfully with major number %d\n", aesd_major);
+    pr_info("AESD character driver loaded successfully with major number %d, %u devices\n", aesd_major,
+            aesd_nr_devs);
     return 0;
+
+fail:
+    /* Cleanup the instances that were registered before the failure */
+    aesd_debugfs_exit();
+    aesd_remove_devices(i);
+    aesd_sysfs_exit();
+    kfree(aesd_devices);
+    aesd_devices = NULL;
+    unregister_chrdev_region(dev, aesd_nr_devs);
+    return result;
 }
 
 /**
@@ -94,10 +214,10 @@ static int __init aesd_init(void)
  *
  * This function is called when the module is unloaded from the kernel.
  * It performs cleanup in reverse order of initialization:
- * 1. Cleanup device resources and free allocated memory
- * 2. Remove character device from kernel
- * 3. Destroy mutex
- * 4. Unregister device number region
+ * 1. Remove the debugfs tree, then for each device: remove the sysfs
+ *    device and the cdev, free stored data and counters, destroy the mutex
+ * 2. Free the device array
+ * 3. Unregister device number region
  *
  * This ensures all resources are properly released when the module is removed.
  */
@@ -107,17 +227,17 @@ static void __exit aesd_exit(void)
 
     pr_info("AESD character driver unloading...\n");
 
-    /* Step 1: Clean up device resources and free allocated memory */
-    aesd_cleanup_device(&aesd_device);
-
-    /* Step 2: Remove character device from kernel */
-    cdev_del(&aesd_device.cdev);
+    /* Step 1: Remove debugfs files first, then every device and its resources */
+    aesd_debugfs_exit();
+    aesd_remove_devices(aesd_nr_devs);
+    aesd_sysfs_exit();
 
-    /* Step 3: Destroy synchronization primitives */
-    mutex_destroy(&aesd_device.lock);
+    /* Step 2: Free the device array */
+    kfree(aesd_devices);
+    aesd_devices = NULL;
 
-    /* Step 4: Unregister the device number region */
-    unregister_chrdev_region(devno, 1);
+    /* Step 3: Unregister the device number region */
+    unregister_chrdev_region(devno, aesd_nr_devs);
 
     pr_info("AESD character driver unloaded successfully\n");
 }
@@ -0,0 +1,343 @@
+/**
+ * @file aesd-bench.c
+ * @brief Multi-threaded microbenchmark of the driver's file operations in userspace
+ *
+ * Links the unmodified driver sources through the kernel shim (see
+ * include/aesd-kshim.h) and drives aesd_fops directly from pthreads, so the
+ * hot paths run under perf, valgrind or the sanitizers with no kernel:
+ * - writers: write commands of a fixed size, split into several write() calls
+ * - readers: read the whole device from position 0, then llseek back
+ * - seekers: AESDCHAR_IOCSEEKTO to a random command, then one read()
+ *
+ * Every thread opens its own file on device 0. At the end the tool prints
+ * ops/s and the mean and worst latency per operation class, and the
+ * driver's own lock counters.
+ *
+ * Usage: aesd-bench [-w writers] [-r readers] [-k seekers] [-s cmd_size]
+ *                   [-c chunks] [-e entries] [-t seconds] [-z]
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define __KERNEL__
+#include "aesdchar.h"
+#include <getopt.h>
+#include <stdatomic.h>
+
+/** @brief Largest number of threads of one kind */
+#define BENCH_MAX_THREADS 64
+
+/**
+ * @brief Operation classes reported separately
+ */
+enum bench_op
+{
+    BENCH_WRITE,
+    BENCH_READ,
+    BENCH_LLSEEK,
+    BENCH_SEEKTO,
+    BENCH_NR_OPS
+};
+
+static const char *const bench_op_names[BENCH_NR_OPS] = {"write", "read", "llseek", "seekto"};
+
+/**
+ * @brief Per-thread counters, summed once the threads have joined
+ */
+struct bench_thread
+{
+    pthread_t thread;
+    struct file filp;
+    unsigned int seed;
+    u64 ops[BENCH_NR_OPS];
+    u64 ns[BENCH_NR_OPS];
+    u64 max_ns[BENCH_NR_OPS];
+    u64 errors;
+};
+
+/** @brief Command size in bytes, newline included */
+static size_t bench_cmd_size = 64;
+
+/** @brief write() calls per command */
+static unsigned int bench_chunks = 1;
+
+/** @brief Cleared by the main thread when the run time is over */
+static atomic_bool bench_running = true;
+
+/** @brief Inode of device 0, shared by every open */
+static struct inode bench_inode;
+
+/**
+ * @brief Account one operation
+ * @param t Thread counters
+ * @param op Operation class
+ * @param start ktime_get_ns() before the call
+ */
+static void bench_account(struct bench_thread *t, enum bench_op op, u64 start)
+{
+    u64 ns = ktime_get_ns() - start;
+
+    t->ops[op]++;
+    t->ns[op] += ns;
+    t->max_ns[op] = max(t->max_ns[op], ns);
+}
+
+/**
+ * @brief Writer thread: complete commands of bench_cmd_size bytes in bench_chunks writes
+ * @param arg struct bench_thread
+ * @return NULL
+ */
+static void *bench_writer(void *arg)
+{
+    struct bench_thread *t = arg;
+    size_t chunk = max_t(size_t, bench_cmd_size / bench_chunks, 1);
+    char *cmd = malloc(bench_cmd_size);
+
+    memset(cmd, 'a' + (t->seed % 26), bench_cmd_size);
+    cmd[bench_cmd_size - 1] = '\n';
+
+    while (atomic_load_explicit(&bench_running, memory_order_relaxed))
+    {
+        size_t done = 0;
+
+        while (done < bench_cmd_size)
+        {
+            size_t len = done + chunk >= bench_cmd_size ? bench_cmd_size - done : chunk;
+            u64 start = ktime_get_ns();
+
+            if (aesd_fops.write(&t->filp, cmd + done, len, &t->filp.f_pos) != (ssize_t)len)
+            {
+                t->errors++;
+            }
+            bench_account(t, BENCH_WRITE, start);
+            done += len;
+        }
+    }
+
+    free(cmd);
+    return NULL;
+}
+
+/**
+ * @brief Reader thread: read everything from position 0, then llseek back
+ * @param arg struct bench_thread
+ * @return NULL
+ */
+static void *bench_reader(void *arg)
+{
+    struct bench_thread *t = arg;
+    char buf[4096];
+
+    while (atomic_load_explicit(&bench_running, memory_order_relaxed))
+    {
+        ssize_t n;
+        u64 start;
+
+        do
+        {
+            start = ktime_get_ns();
+            n = aesd_fops.read(&t->filp, buf, sizeof(buf), &t->filp.f_pos);
+            bench_account(t, BENCH_READ, start);
+        } while (n > 0);
+        if (n < 0)
+        {
+            t->errors++;
+        }
+
+        start = ktime_get_ns();
+        if (aesd_fops.llseek(&t->filp, 0, SEEK_SET) < 0)
+        {
+            t->errors++;
+        }
+        bench_account(t, BENCH_LLSEEK, start);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Seeker thread: AESDCHAR_IOCSEEKTO a random command and read from there
+ * @param arg struct bench_thread
+ * @return NULL
+ *
+ * The command index is drawn below the device capacity, so a seek past the
+ * held commands fails with -EINVAL by design; only other errors count.
+ */
+static void *bench_seeker(void *arg)
+{
+    struct bench_thread *t = arg;
+    struct aesd_dev *dev = &aesd_devices[0];
+    char buf[4096];
+
+    while (atomic_load_explicit(&bench_running, memory_order_relaxed))
+    {
+        struct aesd_seekto seekto = {.write_cmd = rand_r(&t->seed) % READ_ONCE(dev->max_entries)};
+        u64 start = ktime_get_ns();
+        long ret = aesd_fops.unlocked_ioctl(&t->filp, AESDCHAR_IOCSEEKTO, (unsigned long)&seekto);
+
+        bench_account(t, BENCH_SEEKTO, start);
+        if (ret && ret != -EINVAL)
+        {
+            t->errors++;
+        }
+        if (!ret)
+        {
+            start = ktime_get_ns();
+            if (aesd_fops.read(&t->filp, buf, sizeof(buf), &t->filp.f_pos) < 0)
+            {
+                t->errors++;
+            }
+            bench_account(t, BENCH_READ, start);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Print the usage message
+ * @param prog argv[0]
+ */
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-w writers] [-r readers] [-k seekers] [-s cmd_size] [-c chunks] [-e entries] [-t seconds] [-z]\n"
+            "  -w  writer threads (default 4)\n"
+            "  -r  reader threads (default 4)\n"
+            "  -k  AESDCHAR_IOCSEEKTO threads (default 0)\n"
+            "  -s  command size in bytes, newline included (default 64)\n"
+            "  -c  write() calls per command (default 1)\n"
+            "  -e  device capacity in commands (default: the driver's)\n"
+            "  -t  run time in seconds (default 2)\n"
+            "  -z  store commands LZ4-compressed\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct bench_thread threads[3 * BENCH_MAX_THREADS];
+    void *(*roles[3])(void *) = {bench_writer, bench_reader, bench_seeker};
+    unsigned int counts[3] = {4, 4, 0};
+    unsigned int seconds = 2;
+    unsigned int entries = 0;
+    bool compress = false;
+    struct aesd_pcpu_stats sum;
+    struct aesd_dev *dev;
+    u64 total[BENCH_NR_OPS] = {0};
+    u64 total_ns[BENCH_NR_OPS] = {0};
+    u64 worst_ns[BENCH_NR_OPS] = {0};
+    u64 errors = 0;
+    unsigned int nthreads = 0;
+    unsigned int i;
+    int role;
+    int op;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:r:k:s:c:e:t:z")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            counts[0] = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            counts[1] = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            counts[2] = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            bench_cmd_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            bench_chunks = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            entries = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            compress = true;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (counts[0] > BENCH_MAX_THREADS || counts[1] > BENCH_MAX_THREADS || counts[2] > BENCH_MAX_THREADS ||
+        bench_cmd_size < 1 || bench_chunks < 1 || !seconds)
+    {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    if (aesd_shim_module_init())
+    {
+        fprintf(stderr, "aesd_shim_module_init failed\n");
+        return 1;
+    }
+    dev = &aesd_devices[0];
+    bench_inode.i_cdev = &dev->cdev;
+
+    if (entries && aesd_resize_device(dev, entries))
+    {
+        fprintf(stderr, "cannot resize the device to %u commands\n", entries);
+        aesd_shim_module_exit();
+        return 1;
+    }
+    dev->compress = compress;
+
+    for (role = 0; role < 3; role++)
+    {
+        for (i = 0; i < counts[role]; i++)
+        {
+            struct bench_thread *t = &threads[nthreads++];
+
+            t->seed = nthreads;
+            t->filp.f_mode = FMODE_READ | FMODE_WRITE;
+            if (aesd_fops.open(&bench_inode, &t->filp) ||
+                pthread_create(&t->thread, NULL, roles[role], t))
+            {
+                fprintf(stderr, "cannot start thread %u\n", nthreads);
+                return 1;
+            }
+        }
+    }
+
+    sleep(seconds);
+    atomic_store(&bench_running, false);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+        aesd_fops.release(&bench_inode, &threads[i].filp);
+        for (op = 0; op < BENCH_NR_OPS; op++)
+        {
+            total[op] += threads[i].ops[op];
+            total_ns[op] += threads[i].ns[op];
+            worst_ns[op] = max(worst_ns[op], threads[i].max_ns[op]);
+        }
+        errors += threads[i].errors;
+    }
+
+    printf("%u writers, %u readers, %u seekers, %zu-byte commands in %u writes, %u entries, %us%s\n", counts[0],
+           counts[1], counts[2], bench_cmd_size, bench_chunks, dev->max_entries, seconds, compress ? ", lz4" : "");
+    printf("%-8s %12s %12s %10s %12s\n", "op", "count", "ops/s", "mean ns", "max ns");
+    for (op = 0; op < BENCH_NR_OPS; op++)
+    {
+        if (!total[op])
+        {
+            continue;
+        }
+        printf("%-8s %12llu %12.0f %10llu %12llu\n", bench_op_names[op], total[op], (double)total[op] / seconds,
+               total_ns[op] / total[op], worst_ns[op]);
+    }
+
+    aesd_stats_sum(dev, &sum);
+    printf("lock: %llu acquisitions, %llu ns waited, %llu ns held; %llu evictions; %llu errors\n", sum.lock_acquired,
+           sum.lock_wait_ns, sum.lock_hold_ns, sum.evictions, errors);
+
+    aesd_shim_module_exit();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,518 @@
+/**
+ * @file aesd-kshim.h
+ * @brief Userspace stand-ins for the kernel APIs used by the AESD driver
+ *
+ * Lets main.c, char-driver/src and circular-buffer/src compile unchanged
+ * as an ordinary userspace library, so their hot paths can be profiled
+ * with perf, checked with valgrind or the sanitizers, and driven by
+ * multi-threaded benchmarks such as aesd-bench.c:
+ * - kmalloc and friends map onto malloc, struct mutex onto pthread mutexes
+ * - copy_to_user/copy_from_user are memcpy; "user" pointers are plain pointers
+ * - Per-CPU counters collapse to one copy updated with relaxed atomics
+ * - Wait queues are a pthread mutex and condition variable
+ * - Tracepoints, debugfs and sysfs compile to no-ops
+ * - module_init/module_exit become aesd_shim_module_init/exit
+ *
+ * Every <linux/...> header the driver includes has a forwarder to this
+ * file in include/linux (errno.h and types.h first pull in the uapi
+ * versions), so the include directory must come before the system headers
+ * on the command line.
+ *
+ * Only what the driver uses is provided, with the same signatures; the
+ * semantics are simplified where the kernel behaviour cannot matter in a
+ * single process (no signals interrupt locks, no preemption).
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#ifndef AESD_KSHIM_H
+#define AESD_KSHIM_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Types and annotations */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef long long s64;
+
+#define __user
+#define __init
+#define __exit
+#define __percpu
+#define __stringify_1(x) #x
+#define __stringify(x) __stringify_1(x)
+
+#define container_of(ptr, type, member) ((type *)((char *)(ptr)-offsetof(type, member)))
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define u64_to_user_ptr(x) ((void __user *)(uintptr_t)(x))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define U64_MAX UINT64_MAX
+#define ilog2(n) (63 - __builtin_clzll((unsigned long long)(n)))
+
+#define IS_ERR(p) ((unsigned long)(p) >= (unsigned long)-4095)
+#define PTR_ERR(p) ((long)(p))
+
+/* Logging: errors and warnings go to stderr, the rest is compiled out */
+
+#define KERN_DEBUG ""
+#define KERN_INFO ""
+#define pr_debug(fmt, ...) ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#define pr_info(fmt, ...) ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#define printk(fmt, ...) ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#define pr_err(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+
+/* Memory */
+
+#define GFP_KERNEL 0
+
+static inline void *kmalloc(size_t n, int flags) { return malloc(n); }
+static inline void *kzalloc(size_t n, int flags) { return calloc(1, n); }
+static inline void *kcalloc(size_t count, size_t n, int flags) { return calloc(count, n); }
+static inline void *kmalloc_array(size_t count, size_t n, int flags) { return reallocarray(NULL, count, n); }
+static inline void *krealloc(const void *p, size_t n, int flags) { return realloc((void *)p, n); }
+static inline void *kvmalloc(size_t n, int flags) { return malloc(n); }
+static inline void kfree(const void *p) { free((void *)p); }
+static inline void kvfree(const void *p) { free((void *)p); }
+
+/* User copies: the caller's buffers are ordinary pointers, nothing can fault */
+
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+#define put_user(x, ptr) (*(ptr) = (x), 0)
+#define get_user(x, ptr) ((x) = *(ptr), 0)
+
+/* Credentials: the only caller is the process itself, trusted like root */
+
+#define CAP_SYS_ADMIN 21
+
+static inline bool capable(int cap)
+{
+    (void)cap;
+    return true;
+}
+
+/* Locking: no signals, so the interruptible variant always succeeds */
+
+struct mutex
+{
+    pthread_mutex_t m;
+};
+
+static inline void mutex_init(struct mutex *l) { pthread_mutex_init(&l->m, NULL); }
+static inline void mutex_destroy(struct mutex *l) { pthread_mutex_destroy(&l->m); }
+static inline void mutex_lock(struct mutex *l) { pthread_mutex_lock(&l->m); }
+static inline int mutex_lock_interruptible(struct mutex *l) { return pthread_mutex_lock(&l->m); }
+static inline void mutex_unlock(struct mutex *l) { pthread_mutex_unlock(&l->m); }
+
+/* Wait queues: the condition is rechecked under the queue's own mutex, so no wakeup is lost */
+
+typedef struct
+{
+    pthread_mutex_t m;
+    pthread_cond_t c;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *w)
+{
+    pthread_mutex_init(&w->m, NULL);
+    pthread_cond_init(&w->c, NULL);
+}
+
+static inline void wake_up_interruptible(wait_queue_head_t *w)
+{
+    pthread_mutex_lock(&w->m);
+    pthread_cond_broadcast(&w->c);
+    pthread_mutex_unlock(&w->m);
+}
+
+#define wait_event_interruptible(wq, cond)                                                                             \
+    ({                                                                                                                 \
+        pthread_mutex_lock(&(wq).m);                                                                                   \
+        while (!(cond))                                                                                                \
+            pthread_cond_wait(&(wq).c, &(wq).m);                                                                       \
+        pthread_mutex_unlock(&(wq).m);                                                                                 \
+        0;                                                                                                             \
+    })
+
+/* Lists */
+
+struct list_head
+{
+    struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *l) { l->next = l->prev = l; }
+static inline int list_empty(const struct list_head *h) { return h->next == h; }
+
+static inline void list_add_tail(struct list_head *n, struct list_head *h)
+{
+    n->prev = h->prev;
+    n->next = h;
+    h->prev->next = n;
+    h->prev = n;
+}
+
+static inline void list_del_init(struct list_head *n)
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    INIT_LIST_HEAD(n);
+}
+
+#define list_entry(p, type, member) container_of(p, type, member)
+#define list_for_each_entry(pos, head, member)                                                                         \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member); &pos->member != (head);                             \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+/* Atomics */
+
+typedef struct
+{
+    long counter;
+} atomic_long_t;
+
+#define atomic_long_add(v, a) ((void)__atomic_add_fetch(&(a)->counter, (v), __ATOMIC_RELAXED))
+#define atomic_long_sub(v, a) ((void)__atomic_sub_fetch(&(a)->counter, (v), __ATOMIC_RELAXED))
+#define atomic_long_read(a) __atomic_load_n(&(a)->counter, __ATOMIC_RELAXED)
+#define atomic_long_set(a, v) __atomic_store_n(&(a)->counter, (v), __ATOMIC_RELAXED)
+
+/* Per-CPU data: a single shared copy, updated atomically */
+
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(p) free(p)
+#define per_cpu_ptr(p, cpu) (p)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define this_cpu_add(pcp, val) ((void)__atomic_fetch_add(&(pcp), (val), __ATOMIC_RELAXED))
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+
+/* Time */
+
+static inline u64 aesd_shim_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline u64 ktime_get_ns(void) { return aesd_shim_clock_ns(CLOCK_MONOTONIC); }
+static inline u64 ktime_get_real_ns(void) { return aesd_shim_clock_ns(CLOCK_REALTIME); }
+
+/* Modules: parameters keep their defaults, init and exit get callable names */
+
+struct module;
+#define THIS_MODULE ((struct module *)0)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_param_array(name, type, nump, perm) static int *aesd_shim_nump_##name __attribute__((unused)) = nump
+#define module_init(fn)                                                                                                \
+    int aesd_shim_module_init(void)                                                                                    \
+    {                                                                                                                  \
+        return fn();                                                                                                   \
+    }
+#define module_exit(fn)                                                                                                \
+    void aesd_shim_module_exit(void)                                                                                   \
+    {                                                                                                                  \
+        fn();                                                                                                          \
+    }
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 8, 0)
+
+/* Character devices and files: a harness fills struct inode and struct file itself */
+
+#define MINORBITS 20
+#define MKDEV(ma, mi) (((ma) << MINORBITS) | (mi))
+#define MAJOR(d) ((unsigned int)((d) >> MINORBITS))
+#define MINOR(d) ((unsigned int)((d) & ((1U << MINORBITS) - 1)))
+
+#define FMODE_READ 0x1
+#define FMODE_WRITE 0x2
+#define IOCB_NOWAIT (1 << 7)
+#define ITER_SOURCE 1
+#define ITER_DEST 0
+
+struct file;
+struct pipe_inode_info;
+struct file_operations;
+
+struct cdev
+{
+    const struct file_operations *ops;
+    struct module *owner;
+    dev_t dev;
+    unsigned int count;
+};
+
+struct inode
+{
+    struct cdev *i_cdev;
+};
+
+struct file
+{
+    void *private_data;
+    loff_t f_pos;
+    unsigned int f_flags;
+    unsigned int f_mode;
+};
+
+struct kiocb
+{
+    struct file *ki_filp;
+    loff_t ki_pos;
+    int ki_flags;
+};
+
+/* iov_iter over a plain iovec array, the only kind a harness passes */
+struct iov_iter
+{
+    const struct iovec *iov;
+    unsigned long nr_segs;
+    size_t iov_offset;
+    size_t count;
+};
+
+struct file_operations
+{
+    struct module *owner;
+    loff_t (*llseek)(struct file *, loff_t, int);
+    ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    ssize_t (*read_iter)(struct kiocb *, struct iov_iter *);
+    ssize_t (*write_iter)(struct kiocb *, struct iov_iter *);
+    ssize_t (*splice_read)(struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+    ssize_t (*splice_write)(struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
+};
+
+static inline void iov_iter_init(struct iov_iter *i, unsigned int dir, const struct iovec *iov, unsigned long nr_segs,
+                                 size_t count)
+{
+    i->iov = iov;
+    i->nr_segs = nr_segs;
+    i->iov_offset = 0;
+    i->count = count;
+}
+
+static inline size_t iov_iter_count(const struct iov_iter *i) { return i->count; }
+
+static inline size_t aesd_shim_iter_copy(struct iov_iter *i, char *p, size_t bytes, bool to_iter)
+{
+    size_t done = 0;
+
+    bytes = min(bytes, i->count);
+    while (done < bytes)
+    {
+        size_t n = min(bytes - done, i->iov->iov_len - i->iov_offset);
+        char *base = (char *)i->iov->iov_base + i->iov_offset;
+
+        if (to_iter)
+        {
+            memcpy(base, p + done, n);
+        }
+        else
+        {
+            memcpy(p + done, base, n);
+        }
+        done += n;
+        i->iov_offset += n;
+        i->count -= n;
+        if (i->iov_offset == i->iov->iov_len)
+        {
+            i->iov++;
+            i->nr_segs--;
+            i->iov_offset = 0;
+        }
+    }
+    return done;
+}
+
+static inline size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
+{
+    return aesd_shim_iter_copy(i, (char *)addr, bytes, true);
+}
+
+static inline size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i)
+{
+    return aesd_shim_iter_copy(i, addr, bytes, false);
+}
+
+/* No pipes in userspace; splice is exercised through read_iter/write_iter instead */
+static inline ssize_t copy_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t len,
+                                       unsigned int flags)
+{
+    return -EINVAL;
+}
+
+static inline ssize_t iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t len,
+                                             unsigned int flags)
+{
+    return -EINVAL;
+}
+
+static inline void cdev_init(struct cdev *c, const struct file_operations *fops)
+{
+    memset(c, 0, sizeof(*c));
+    c->ops = fops;
+}
+
+static inline int cdev_add(struct cdev *c, dev_t dev, unsigned int count)
+{
+    c->dev = dev;
+    c->count = count;
+    return 0;
+}
+
+static inline void cdev_del(struct cdev *c) {}
+
+static inline int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name)
+{
+    *dev = MKDEV(240, baseminor);
+    return 0;
+}
+
+static inline void unregister_chrdev_region(dev_t dev, unsigned int count) {}
+
+/* debugfs: no files are created, the show functions are only type-checked */
+
+struct dentry;
+
+struct seq_file
+{
+    void *private;
+};
+
+#define seq_printf(s, fmt, ...) ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#define DEFINE_SHOW_ATTRIBUTE(name)                                                                                    \
+    static int (*const name##_show_ref)(struct seq_file *, void *) __attribute__((unused)) = name##_show;              \
+    static const struct file_operations name##_fops = {.owner = THIS_MODULE}
+
+static inline struct dentry *debugfs_create_dir(const char *name, struct dentry *parent) { return NULL; }
+static inline struct dentry *debugfs_create_file(const char *name, unsigned short mode, struct dentry *parent,
+                                                 void *data, const struct file_operations *fops)
+{
+    return NULL;
+}
+static inline void debugfs_remove_recursive(struct dentry *dentry) {}
+
+/* sysfs: class devices only carry drvdata, attributes are not reachable */
+
+struct class
+{
+    int unused;
+};
+
+struct device
+{
+    void *drvdata;
+};
+
+struct attribute
+{
+    const char *name;
+};
+
+struct attribute_group
+{
+    struct attribute **attrs;
+};
+
+struct device_attribute
+{
+    struct attribute attr;
+    ssize_t (*show)(struct device *, struct device_attribute *, char *);
+    ssize_t (*store)(struct device *, struct device_attribute *, const char *, size_t);
+};
+
+#define DEVICE_ATTR_RW(name) struct device_attribute dev_attr_##name = {{#name}, name##_show, name##_store}
+#define ATTRIBUTE_GROUPS(name)                                                                                         \
+    static const struct attribute_group name##_group = {name##_attrs};                                                 \
+    static const struct attribute_group *name##_groups[] = {&name##_group, NULL}
+#define sysfs_emit(buf, ...) sprintf(buf, __VA_ARGS__)
+
+static inline struct class *class_create(const char *name) { return calloc(1, sizeof(struct class)); }
+static inline void class_destroy(struct class *cls) { free(cls); }
+static inline void device_destroy(struct class *cls, dev_t devt) {}
+static inline void *dev_get_drvdata(const struct device *dev) { return dev->drvdata; }
+
+/* One class device per minor, enough for AESD_MAX_DEVS */
+static inline struct device *device_create_with_groups(struct class *cls, struct device *parent, dev_t devt,
+                                                       void *drvdata, const struct attribute_group **groups,
+                                                       const char *fmt, ...)
+{
+    static struct device devices[1U << 8];
+    struct device *dev = &devices[MINOR(devt) & 0xff];
+
+    dev->drvdata = drvdata;
+    return dev;
+}
+
+static inline int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+    char *end;
+    unsigned long v;
+
+    errno = 0;
+    v = strtoul(s, &end, base);
+    if (end == s || (*end && strcmp(end, "\n")) || errno || v > UINT32_MAX)
+    {
+        return -EINVAL;
+    }
+    *res = v;
+    return 0;
+}
+
+/* Harness entry points, generated from main.c's module_init and module_exit */
+
+/**
+ * @brief Run the driver's module init: register and initialize the devices
+ * @return 0 on success, negative error code on failure
+ */
+int aesd_shim_module_init(void);
+
+/**
+ * @brief Run the driver's module exit: free every device
+ */
+void aesd_shim_module_exit(void);
+
+#endif /* AESD_KSHIM_H */
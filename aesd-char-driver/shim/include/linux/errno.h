@@ -0,0 +1,6 @@
+/* Userspace stand-in: the uapi error numbers plus the kernel-internal ones */
+#include_next <linux/errno.h>
+
+#ifndef ERESTARTSYS
+#define ERESTARTSYS 512
+#endif
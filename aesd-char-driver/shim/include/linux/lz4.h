@@ -0,0 +1,25 @@
+/* Userspace stand-in for <linux/lz4.h>, see aesd-kshim.h */
+#ifndef AESD_KSHIM_LZ4_H
+#define AESD_KSHIM_LZ4_H
+
+#include "../aesd-kshim.h"
+
+#define LZ4_MAX_INPUT_SIZE 0x7E000000
+
+#ifdef AESD_SHIM_NO_LZ4
+/* Built without liblz4: compression never shrinks, so commands stay plain */
+#define LZ4_MEM_COMPRESS 1
+static inline int LZ4_compressBound(int size) { return size; }
+static inline int LZ4_compress_default(const char *src, char *dst, int size, int capacity, void *wrkmem) { return 0; }
+static inline int LZ4_decompress_safe(const char *src, char *dst, int size, int capacity) { return -1; }
+#else
+/* The liblz4 entry points the kernel API maps onto; lz4.h itself is not needed */
+int LZ4_compress_fast_extState(void *state, const char *src, char *dst, int srcSize, int dstCapacity, int acceleration);
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize, int dstCapacity);
+int LZ4_sizeofState(void);
+int LZ4_compressBound(int inputSize);
+#define LZ4_MEM_COMPRESS LZ4_sizeofState()
+#define LZ4_compress_default(src, dst, size, capacity, wrkmem) LZ4_compress_fast_extState(wrkmem, src, dst, size, capacity, 1)
+#endif
+
+#endif
@@ -0,0 +1,3 @@
+/* Userspace stand-in: the uapi types, then the kernel ones from aesd-kshim.h */
+#include_next <linux/types.h>
+#include "../aesd-kshim.h"
@@ -0,0 +1 @@
+/* Userspace stand-in: tracepoints are not instantiated */
@@ -0,0 +1,881 @@
+/**
+ * @file aesdchar-stress.c
+ * @brief Multi-threaded load and integrity tool for /dev/aesdchar
+ *
+ * Runs writer and reader threads against the device, each on its own open
+ * file, for a fixed time:
+ * - Writers write self-describing commands with sizes drawn from a weighted
+ *   mix, optionally split over several write() calls
+ * - Readers read sequentially and, for a configurable share of their
+ *   operations, lseek() to a random offset or AESDCHAR_IOCSEEKTO a random
+ *   command instead; at end of data they rewind to 0
+ *
+ * Every command is "@wwww:ssssssss:llllll payload\n": writer id, per-writer
+ * sequence number and total length in hex, then a payload derived from all
+ * three. Readers check each command they see in full: length, payload, and
+ * that one writer's sequence numbers only go up between two seeks.
+ *
+ * By default readers register as consumers (AESDCHAR_IOCCONSUMER) so their
+ * cursor stays on command boundaries when old commands are dropped; the only
+ * torn lines are then a command cut by eviction followed by a whole one, and
+ * any other mismatch is reported as corruption. With -C the readers use
+ * plain file positions, which shift on eviction, and mismatches only count
+ * as torn lines.
+ *
+ * Devices without AESDCHAR_IOCGETINFO, such as the CUSE daemon, are run
+ * as with -C, assuming the default capacity of
+ * STRESS_DEFAULT_CAPACITY commands for the SEEKTO targets.
+ *
+ * The report gives ops/s and p50/p99/p999/max latency per operation, from
+ * log-linear histograms (6% resolution), and the integrity counters. The
+ * exit status is 1 on corruption, reordering or I/O errors.
+ *
+ * Usage: aesdchar-stress [-d /dev/aesdchar] [-w 4] [-r 4] [-s 64,1024:2] [-c 1]
+ *                        [-l 0] [-k 0] [-t 5] [-C]
+ *
+ * @author Ekpenyong-Esu
+ */
+
+#define _GNU_SOURCE /* memrchr */
+#include "../aesd_ioctl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @brief Length of the "@wwww:ssssssss:llllll " command header */
+#define STRESS_HDR_LEN 22
+
+/** @brief Largest command, header and newline included */
+#define STRESS_MAX_CMD (1024 * 1024)
+
+/** @brief Most entries accepted in the -s size mix */
+#define STRESS_MAX_SIZES 16
+
+/** @brief Most threads of one kind; writer ids must fit the 4 hex digits */
+#define STRESS_MAX_THREADS 256
+
+/** @brief Capacity assumed without AESDCHAR_IOCGETINFO, the driver's default */
+#define STRESS_DEFAULT_CAPACITY 10
+
+/** @brief Bytes requested by each read() */
+#define STRESS_READ_SIZE 65536
+
+/** @brief Sub-buckets per power of two in the latency histograms */
+#define STRESS_HIST_SUB 16
+
+/** @brief Histogram buckets, enough for any 64-bit nanosecond value */
+#define STRESS_HIST_BUCKETS (61 * STRESS_HIST_SUB)
+
+/**
+ * @brief Operation classes with their own latency histogram
+ */
+enum stress_op
+{
+    STRESS_WRITE,
+    STRESS_READ,
+    STRESS_LLSEEK,
+    STRESS_SEEKTO,
+    STRESS_NR_OPS
+};
+
+static const char *const stress_op_names[STRESS_NR_OPS] = {"write", "read", "lseek", "seekto"};
+
+/**
+ * @brief One entry of the command size mix
+ */
+struct stress_size
+{
+    /** @brief Command length, header and newline included */
+    size_t size;
+
+    /** @brief Relative weight in the mix */
+    unsigned int weight;
+};
+
+/**
+ * @brief Command line settings, read-only once the threads start
+ */
+struct stress_opts
+{
+    const char *device;
+    unsigned int writers;
+    unsigned int readers;
+    struct stress_size sizes[STRESS_MAX_SIZES];
+    unsigned int nsizes;
+    unsigned int total_weight;
+    size_t max_size;
+    unsigned int chunks;
+    unsigned int lseek_pct;
+    unsigned int seekto_pct;
+    unsigned int seconds;
+    bool consumers;
+};
+
+/**
+ * @brief Per-thread state and counters, summed after the join
+ */
+struct stress_thread
+{
+    pthread_t thread;
+    unsigned int id;
+    unsigned int seed;
+    int fd;
+
+    /** @brief Latency histograms in nanoseconds, see stress_hist_bucket() */
+    unsigned long long hist[STRESS_NR_OPS][STRESS_HIST_BUCKETS];
+    unsigned long long max_ns[STRESS_NR_OPS];
+    unsigned long long ops[STRESS_NR_OPS];
+
+    unsigned long long bytes;
+    unsigned long long commands;
+    unsigned long long verified;
+    unsigned long long torn;
+    unsigned long long corrupt;
+    unsigned long long reordered;
+    unsigned long long seekto_misses;
+    unsigned long long errors;
+
+    /** @brief Reader: last sequence number seen per writer since the last seek, -1 for none */
+    long long *last_seq;
+};
+
+static struct stress_opts stress_opts = {
+    .device = "/dev/aesdchar",
+    .writers = 4,
+    .readers = 4,
+    .chunks = 1,
+    .seconds = 5,
+    .consumers = true,
+};
+
+/** @brief Device capacity from AESDCHAR_IOCGETINFO, bounds the SEEKTO targets */
+static uint32_t stress_capacity;
+
+/** @brief Cleared by the main thread when the run time is over */
+static atomic_bool stress_running = true;
+
+/** @brief Writers still running; readers drain until it drops to 0 */
+static atomic_uint stress_writers_active;
+
+/**
+ * @brief Monotonic time in nanoseconds
+ * @return Current CLOCK_MONOTONIC value
+ */
+static unsigned long long stress_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Histogram bucket of a latency
+ * @param ns Latency in nanoseconds
+ * @return Bucket index: exact below 16 ns, then 16 sub-buckets per power of two
+ */
+static unsigned int stress_hist_bucket(unsigned long long ns)
+{
+    unsigned int msb;
+
+    if (ns < STRESS_HIST_SUB)
+    {
+        return ns;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    return (msb - 3) * STRESS_HIST_SUB + ((ns >> (msb - 4)) & (STRESS_HIST_SUB - 1));
+}
+
+/**
+ * @brief Lowest latency that falls in a bucket
+ * @param bucket Bucket index from stress_hist_bucket()
+ * @return Lower bound in nanoseconds
+ */
+static unsigned long long stress_hist_value(unsigned int bucket)
+{
+    unsigned int msb;
+
+    if (bucket < STRESS_HIST_SUB)
+    {
+        return bucket;
+    }
+    msb = bucket / STRESS_HIST_SUB + 3;
+    return (unsigned long long)(STRESS_HIST_SUB + bucket % STRESS_HIST_SUB) << (msb - 4);
+}
+
+/**
+ * @brief Record one operation
+ * @param t Thread state
+ * @param op Operation class
+ * @param start stress_now_ns() before the call
+ */
+static void stress_account(struct stress_thread *t, enum stress_op op, unsigned long long start)
+{
+    unsigned long long ns = stress_now_ns() - start;
+
+    t->hist[op][stress_hist_bucket(ns)]++;
+    t->ops[op]++;
+    if (ns > t->max_ns[op])
+    {
+        t->max_ns[op] = ns;
+    }
+}
+
+/**
+ * @brief Payload byte of a command
+ * @param writer Writer id
+ * @param seq Sequence number of the command
+ * @param i Payload offset
+ * @return Expected byte, always 'a' to 'z' so it never looks like a header or newline
+ */
+static char stress_pattern(unsigned int writer, unsigned int seq, size_t i)
+{
+    return 'a' + (writer * 7 + seq * 13 + i) % 26;
+}
+
+/**
+ * @brief Build a command in buf
+ * @param buf Output, at least size bytes
+ * @param size Total length, at least STRESS_HDR_LEN + 1
+ * @param writer Writer id
+ * @param seq Sequence number
+ */
+static void stress_fill(char *buf, size_t size, unsigned int writer, unsigned int seq)
+{
+    size_t i;
+
+    snprintf(buf, STRESS_HDR_LEN + 1, "@%04x:%08x:%06zx ", writer, seq, size);
+    for (i = 0; i < size - STRESS_HDR_LEN - 1; i++)
+    {
+        buf[STRESS_HDR_LEN + i] = stress_pattern(writer, seq, i);
+    }
+    buf[size - 1] = '\n';
+}
+
+/**
+ * @brief Parse a fixed-width hex field
+ * @param p Field start
+ * @param len Field width
+ * @param value Output
+ * @return true if every character is a lowercase hex digit
+ */
+static bool stress_parse_hex(const char *p, size_t len, unsigned long *value)
+{
+    size_t i;
+
+    *value = 0;
+    for (i = 0; i < len; i++)
+    {
+        int digit;
+
+        if (p[i] >= '0' && p[i] <= '9')
+        {
+            digit = p[i] - '0';
+        }
+        else if (p[i] >= 'a' && p[i] <= 'f')
+        {
+            digit = p[i] - 'a' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        *value = *value * 16 + digit;
+    }
+    return true;
+}
+
+/**
+ * @brief Check one whole command
+ * @param t Reader state, for the per-writer ordering check
+ * @param cmd Command start, at its '@'
+ * @param len Length without the newline
+ * @return true if the header, length and payload match
+ */
+static bool stress_verify(struct stress_thread *t, const char *cmd, size_t len)
+{
+    unsigned long writer;
+    unsigned long seq;
+    unsigned long size;
+    size_t i;
+
+    if (len < STRESS_HDR_LEN || cmd[5] != ':' || cmd[14] != ':' || cmd[21] != ' ' ||
+        !stress_parse_hex(cmd + 1, 4, &writer) || !stress_parse_hex(cmd + 6, 8, &seq) ||
+        !stress_parse_hex(cmd + 15, 6, &size) || size != len + 1 || writer >= stress_opts.writers)
+    {
+        return false;
+    }
+
+    for (i = 0; i < len - STRESS_HDR_LEN; i++)
+    {
+        if (cmd[STRESS_HDR_LEN + i] != stress_pattern(writer, seq, i))
+        {
+            return false;
+        }
+    }
+
+    if (t->last_seq[writer] >= (long long)seq)
+    {
+        t->reordered++;
+    }
+    t->last_seq[writer] = seq;
+    return true;
+}
+
+/**
+ * @brief Classify one line read from the device
+ * @param t Reader state
+ * @param line Line start
+ * @param len Length without the newline
+ *
+ * Only the text from the last '@' on can be a whole command, since payloads
+ * never contain one; anything before it is the remains of a command cut
+ * short by eviction or a seek.
+ */
+static void stress_check_line(struct stress_thread *t, const char *line, size_t len)
+{
+    const char *cmd = memrchr(line, '@', len);
+
+    if (cmd && stress_verify(t, cmd, len - (cmd - line)))
+    {
+        t->verified++;
+        if (cmd != line)
+        {
+            t->torn++;
+        }
+    }
+    else if (stress_opts.consumers)
+    {
+        t->corrupt++;
+    }
+    else
+    {
+        t->torn++;
+    }
+}
+
+/**
+ * @brief Forget the ordering history after the reader moves
+ * @param t Reader state
+ */
+static void stress_reset_order(struct stress_thread *t)
+{
+    memset(t->last_seq, 0xff, stress_opts.writers * sizeof(*t->last_seq));
+}
+
+/**
+ * @brief Draw a command size from the mix
+ * @param t Thread state, for the random seed
+ * @return Command length
+ */
+static size_t stress_pick_size(struct stress_thread *t)
+{
+    unsigned int r = rand_r(&t->seed) % stress_opts.total_weight;
+    unsigned int i;
+
+    for (i = 0; r >= stress_opts.sizes[i].weight; i++)
+    {
+        r -= stress_opts.sizes[i].weight;
+    }
+    return stress_opts.sizes[i].size;
+}
+
+/**
+ * @brief Writer thread: write commands until the run time is over
+ * @param arg struct stress_thread
+ * @return NULL
+ */
+static void *stress_writer(void *arg)
+{
+    struct stress_thread *t = arg;
+    char *cmd = malloc(stress_opts.max_size);
+    unsigned int seq = 0;
+
+    if (!cmd)
+    {
+        t->errors++;
+        goto out;
+    }
+
+    while (atomic_load_explicit(&stress_running, memory_order_relaxed))
+    {
+        size_t size = stress_pick_size(t);
+        size_t chunk = size / stress_opts.chunks ? size / stress_opts.chunks : 1;
+        size_t done = 0;
+
+        stress_fill(cmd, size, t->id, seq++);
+        while (done < size)
+        {
+            size_t len = size - done > chunk ? chunk : size - done;
+            unsigned long long start = stress_now_ns();
+            ssize_t ret = write(t->fd, cmd + done, len);
+
+            stress_account(t, STRESS_WRITE, start);
+            if (ret < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ret <= 0)
+            {
+                t->errors++;
+                goto out;
+            }
+            done += ret;
+            t->bytes += ret;
+        }
+        t->commands++;
+    }
+
+out:
+    free(cmd);
+    close(t->fd);
+    atomic_fetch_sub(&stress_writers_active, 1);
+    return NULL;
+}
+
+/**
+ * @brief lseek() wrapper that records the latency
+ * @param t Thread state
+ * @param offset Offset
+ * @param whence SEEK_SET or SEEK_END
+ * @return New position, -1 on error
+ */
+static off_t stress_lseek(struct stress_thread *t, off_t offset, int whence)
+{
+    unsigned long long start = stress_now_ns();
+    off_t pos = lseek(t->fd, offset, whence);
+
+    stress_account(t, STRESS_LLSEEK, start);
+    if (pos < 0)
+    {
+        t->errors++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Reader thread: read, lseek and SEEKTO until the run time is over
+ * @param arg struct stress_thread
+ * @return NULL
+ *
+ * Data is reassembled into lines in buf. After a random lseek the reader
+ * may be inside a command, so the text up to the next newline is dropped
+ * unchecked; rewinds and SEEKTO land on command starts.
+ *
+ * Readers keep going until every writer has stopped: on a lossless device
+ * a writer may be waiting for them, and with no consumer left it would
+ * wait forever.
+ */
+static void *stress_reader(void *arg)
+{
+    struct stress_thread *t = arg;
+    size_t cap = 2 * stress_opts.max_size + STRESS_READ_SIZE;
+    char *buf = malloc(cap);
+    size_t carry = 0;
+    bool aligned = true;
+
+    if (!buf)
+    {
+        t->errors++;
+        goto out;
+    }
+    stress_reset_order(t);
+
+    while (atomic_load_explicit(&stress_running, memory_order_relaxed) || atomic_load(&stress_writers_active))
+    {
+        unsigned int r = rand_r(&t->seed) % 100;
+        unsigned long long start;
+        ssize_t n;
+        char *line;
+        char *nl;
+
+        if (r < stress_opts.lseek_pct)
+        {
+            off_t end = stress_lseek(t, 0, SEEK_END);
+            off_t pos;
+
+            if (end < 0)
+            {
+                break;
+            }
+            start = stress_now_ns();
+            pos = lseek(t->fd, end ? rand_r(&t->seed) % end : 0, SEEK_SET);
+            stress_account(t, STRESS_LLSEEK, start);
+            if (pos < 0 && errno != EINVAL)
+            {
+                t->errors++;
+                break;
+            }
+            /* EINVAL: commands were dropped since SEEK_END and the offset is past the end */
+            carry = 0;
+            aligned = false;
+            stress_reset_order(t);
+            continue;
+        }
+        if (r < stress_opts.lseek_pct + stress_opts.seekto_pct)
+        {
+            struct aesd_seekto seekto = {.write_cmd = rand_r(&t->seed) % stress_capacity};
+            int ret;
+
+            start = stress_now_ns();
+            ret = ioctl(t->fd, AESDCHAR_IOCSEEKTO, &seekto);
+            stress_account(t, STRESS_SEEKTO, start);
+            if (ret && errno == EINVAL)
+            {
+                /* Fewer commands held than the capacity */
+                t->seekto_misses++;
+                continue;
+            }
+            if (ret)
+            {
+                t->errors++;
+                break;
+            }
+            carry = 0;
+            aligned = true;
+            stress_reset_order(t);
+            continue;
+        }
+
+        if (carry > 2 * stress_opts.max_size)
+        {
+            /* No newline in two commands' worth of data: lost our place */
+            t->torn++;
+            carry = 0;
+            aligned = false;
+        }
+
+        start = stress_now_ns();
+        n = read(t->fd, buf + carry, cap - carry);
+        stress_account(t, STRESS_READ, start);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            t->errors++;
+            break;
+        }
+        if (n == 0)
+        {
+            if (stress_lseek(t, 0, SEEK_SET) < 0)
+            {
+                break;
+            }
+            carry = 0;
+            aligned = true;
+            stress_reset_order(t);
+            continue;
+        }
+        t->bytes += n;
+        carry += n;
+
+        line = buf;
+        while ((nl = memchr(line, '\n', carry - (line - buf))))
+        {
+            if (aligned)
+            {
+                stress_check_line(t, line, nl - line);
+            }
+            aligned = true;
+            line = nl + 1;
+        }
+        carry -= line - buf;
+        memmove(buf, line, carry);
+    }
+
+out:
+    free(buf);
+    close(t->fd);
+    return NULL;
+}
+
+/**
+ * @brief Parse the -s size mix, "size[:weight],..."
+ * @param arg Option argument
+ * @return true on success
+ */
+static bool stress_parse_sizes(char *arg)
+{
+    char *save = NULL;
+    char *tok;
+
+    stress_opts.nsizes = 0;
+    stress_opts.total_weight = 0;
+    stress_opts.max_size = 0;
+    for (tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        struct stress_size *s = &stress_opts.sizes[stress_opts.nsizes];
+        char *end;
+
+        if (stress_opts.nsizes == STRESS_MAX_SIZES)
+        {
+            return false;
+        }
+        s->size = strtoul(tok, &end, 0);
+        s->weight = *end == ':' ? strtoul(end + 1, &end, 0) : 1;
+        if (*end || s->size <= STRESS_HDR_LEN || s->size > STRESS_MAX_CMD || !s->weight)
+        {
+            return false;
+        }
+        stress_opts.total_weight += s->weight;
+        if (s->size > stress_opts.max_size)
+        {
+            stress_opts.max_size = s->size;
+        }
+        stress_opts.nsizes++;
+    }
+    return stress_opts.nsizes > 0;
+}
+
+/**
+ * @brief Print the usage message
+ * @param prog argv[0]
+ */
+static void stress_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-d device] [-w writers] [-r readers] [-s sizes] [-c chunks] [-l pct] [-k pct] [-t seconds] "
+            "[-C]\n"
+            "  -d  device (default /dev/aesdchar)\n"
+            "  -w  writer threads (default 4)\n"
+            "  -r  reader threads (default 4)\n"
+            "  -s  command size mix, size[:weight],... with sizes %d to %d (default 64)\n"
+            "  -c  write() calls per command (default 1)\n"
+            "  -l  percent of reader operations that lseek to a random offset (default 0)\n"
+            "  -k  percent of reader operations that AESDCHAR_IOCSEEKTO a random command (default 0)\n"
+            "  -t  run time in seconds (default 5)\n"
+            "  -C  readers use plain file positions instead of registering as consumers\n",
+            prog, STRESS_HDR_LEN + 1, STRESS_MAX_CMD);
+}
+
+/**
+ * @brief Print one line of the latency table
+ * @param threads All threads
+ * @param nthreads Number of threads
+ * @param op Operation class
+ * @param seconds Elapsed time
+ */
+static void stress_report_op(struct stress_thread *threads, unsigned int nthreads, enum stress_op op, double seconds)
+{
+    static unsigned long long hist[STRESS_HIST_BUCKETS];
+    static const double quantiles[] = {0.50, 0.99, 0.999};
+    unsigned long long value[3] = {0};
+    unsigned long long total = 0;
+    unsigned long long max_ns = 0;
+    unsigned long long seen = 0;
+    unsigned int bucket;
+    unsigned int q = 0;
+    unsigned int i;
+
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < nthreads; i++)
+    {
+        for (bucket = 0; bucket < STRESS_HIST_BUCKETS; bucket++)
+        {
+            hist[bucket] += threads[i].hist[op][bucket];
+        }
+        total += threads[i].ops[op];
+        if (threads[i].max_ns[op] > max_ns)
+        {
+            max_ns = threads[i].max_ns[op];
+        }
+    }
+    if (!total)
+    {
+        return;
+    }
+
+    for (bucket = 0; bucket < STRESS_HIST_BUCKETS && q < 3; bucket++)
+    {
+        seen += hist[bucket];
+        while (q < 3 && seen >= quantiles[q] * total)
+        {
+            value[q++] = stress_hist_value(bucket);
+        }
+    }
+
+    printf("%-8s %12llu %12.0f %10.1f %10.1f %10.1f %10.1f\n", stress_op_names[op], total, total / seconds,
+           value[0] / 1000.0, value[1] / 1000.0, value[2] / 1000.0, max_ns / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct stress_thread threads[2 * STRESS_MAX_THREADS];
+    struct stress_thread sum = {0};
+    unsigned long long bytes_written = 0;
+    unsigned long long bytes_read = 0;
+    struct aesd_info info = {0};
+    unsigned long long start;
+    unsigned int nthreads = 0;
+    unsigned int i;
+    double seconds;
+    char default_sizes[] = "64";
+    int opt;
+    int op;
+    int fd;
+
+    stress_parse_sizes(default_sizes);
+    while ((opt = getopt(argc, argv, "d:w:r:s:c:l:k:t:C")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            stress_opts.device = optarg;
+            break;
+        case 'w':
+            stress_opts.writers = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            stress_opts.readers = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            if (!stress_parse_sizes(optarg))
+            {
+                stress_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            stress_opts.chunks = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            stress_opts.lseek_pct = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            stress_opts.seekto_pct = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            stress_opts.seconds = strtoul(optarg, NULL, 0);
+            break;
+        case 'C':
+            stress_opts.consumers = false;
+            break;
+        default:
+            stress_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (stress_opts.writers > STRESS_MAX_THREADS || stress_opts.readers > STRESS_MAX_THREADS ||
+        !stress_opts.chunks || stress_opts.lseek_pct + stress_opts.seekto_pct > 100 || !stress_opts.seconds)
+    {
+        stress_usage(argv[0]);
+        return 1;
+    }
+
+    /* Capacity bounds the SEEKTO targets; also checks this is an aesdchar device */
+    fd = open(stress_opts.device, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(stress_opts.device);
+        return 1;
+    }
+    if (ioctl(fd, AESDCHAR_IOCGETINFO, &info) == 0)
+    {
+        stress_capacity = info.capacity ? info.capacity : 1;
+    }
+    else if (errno == ENOTTY)
+    {
+        /* The CUSE daemon has neither GETINFO nor consumer registration */
+        fprintf(stderr,
+                "%s: no AESDCHAR_IOCGETINFO, assuming capacity %u and plain reader positions (-C)\n",
+                stress_opts.device, STRESS_DEFAULT_CAPACITY);
+        stress_capacity = STRESS_DEFAULT_CAPACITY;
+        stress_opts.consumers = false;
+    }
+    else
+    {
+        perror(stress_opts.device);
+        return 1;
+    }
+    close(fd);
+
+    atomic_store(&stress_writers_active, stress_opts.writers);
+    for (i = 0; i < stress_opts.writers + stress_opts.readers; i++)
+    {
+        struct stress_thread *t = &threads[nthreads];
+        bool writer = i < stress_opts.writers;
+        uint32_t on = 1;
+
+        t->id = writer ? i : i - stress_opts.writers;
+        t->seed = i + 1;
+        t->fd = open(stress_opts.device, writer ? O_WRONLY : O_RDONLY);
+        if (t->fd < 0)
+        {
+            perror(stress_opts.device);
+            return 1;
+        }
+        if (!writer)
+        {
+            t->last_seq = calloc(stress_opts.writers + 1, sizeof(*t->last_seq));
+            if (!t->last_seq || (stress_opts.consumers && ioctl(t->fd, AESDCHAR_IOCCONSUMER, &on)))
+            {
+                perror("reader setup");
+                return 1;
+            }
+        }
+        if (pthread_create(&t->thread, NULL, writer ? stress_writer : stress_reader, t))
+        {
+            fprintf(stderr, "cannot start thread %u\n", i);
+            return 1;
+        }
+        nthreads++;
+    }
+
+    start = stress_now_ns();
+    sleep(stress_opts.seconds);
+    atomic_store(&stress_running, false);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+    }
+    seconds = (stress_now_ns() - start) / 1e9;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        struct stress_thread *t = &threads[i];
+
+        if (i < stress_opts.writers)
+        {
+            bytes_written += t->bytes;
+            sum.commands += t->commands;
+        }
+        else
+        {
+            bytes_read += t->bytes;
+        }
+        sum.verified += t->verified;
+        sum.torn += t->torn;
+        sum.corrupt += t->corrupt;
+        sum.reordered += t->reordered;
+        sum.seekto_misses += t->seekto_misses;
+        sum.errors += t->errors;
+        free(t->last_seq);
+    }
+
+    printf("%s: %u writers, %u readers%s, %u-way writes, lseek %u%%, seekto %u%%, capacity %u, %.2fs\n",
+           stress_opts.device, stress_opts.writers, stress_opts.readers, stress_opts.consumers ? " (consumers)" : "",
+           stress_opts.chunks, stress_opts.lseek_pct, stress_opts.seekto_pct, stress_capacity, seconds);
+    printf("%-8s %12s %12s %10s %10s %10s %10s\n", "op", "count", "ops/s", "p50 us", "p99 us", "p999 us", "max us");
+    for (op = 0; op < STRESS_NR_OPS; op++)
+    {
+        stress_report_op(threads, nthreads, op, seconds);
+    }
+    printf("written: %llu commands, %.1f MB/s\n", sum.commands, bytes_written / seconds / 1e6);
+    printf("read:    %.1f MB/s\n", bytes_read / seconds / 1e6);
+    printf("integrity: %llu verified, %llu torn, %llu corrupt, %llu reordered, %llu seekto misses, %llu errors\n",
+           sum.verified, sum.torn, sum.corrupt, sum.reordered, sum.seekto_misses, sum.errors);
+
+    return sum.corrupt || sum.reordered || sum.errors ? 1 : 0;
+}
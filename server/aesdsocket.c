@@ -19,24 +19,95 @@
 #include <unistd.h>
 
 #include "../server/aesdsocket_app/include/aesd_socket.h"
+#include "../server/aesdsocket_app/include/data_file.h"
+#include "../server/aesdsocket_app/include/event_loop.h"
+#include "../server/aesdsocket_app/include/mem_pool.h"
 #include "../server/aesdsocket_app/include/signal_handler.h"
 #include "../server/aesdsocket_app/include/socket_ops.h"
 #include "../server/aesdsocket_app/include/thread_manager.h"
+#include "../server/aesdsocket_app/include/worker_pool.h"
 
 // Global variables defined in aesd_socket.h
-volatile sig_atomic_t keep_running = 1;
+atomic_int keep_running = 1;
 int server_socket = -1;
 pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t thread_list_mutex = PTHREAD_MUTEX_INITIALIZER;
-thread_node_t *thread_list_head = NULL;
 
 #if !USE_AESD_CHAR_DEVICE
 pthread_t timer_thread;
 #endif
 
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d] [-m threads|epoll] [-j reactors] [-w workers] [-q depth] [-r]\n", prog);
+    fprintf(stderr, "  -d  run as a daemon\n");
+    fprintf(stderr, "  -m  threads: worker thread pool (default); epoll: non-blocking reactors\n");
+    fprintf(stderr, "  -j  number of epoll reactors, 1 to %d (default 1)\n", MAX_REACTORS);
+    fprintf(stderr, "  -w  number of worker threads, 1 to %d (default %d)\n", MAX_WORKERS, DEFAULT_WORKERS);
+    fprintf(stderr, "  -q  accepted clients queued for the workers, 1 to %d (default %d)\n", MAX_QUEUE_DEPTH,
+            DEFAULT_QUEUE_DEPTH);
+    fprintf(stderr, "  -r  close new clients while the queue is full (default: stop accepting until a slot frees)\n");
+}
+
 int main(int argc, char *argv[])
 {
-    int daemon_mode = (argc == 2 && strcmp(argv[1], "-d") == 0);
+    int daemon_mode = 0;
+    int use_epoll = 0;
+    int nreactors = 1;
+    int nworkers = DEFAULT_WORKERS;
+    int queue_depth = DEFAULT_QUEUE_DEPTH;
+    int reject_when_full = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "dm:j:w:q:r")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            daemon_mode = 1;
+            break;
+        case 'm':
+            if (strcmp(optarg, "epoll") == 0)
+            {
+                use_epoll = 1;
+            }
+            else if (strcmp(optarg, "threads") != 0)
+            {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'j':
+            nreactors = atoi(optarg);
+            if (nreactors < 1 || nreactors > MAX_REACTORS)
+            {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'w':
+            nworkers = atoi(optarg);
+            if (nworkers < 1 || nworkers > MAX_WORKERS)
+            {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'q':
+            queue_depth = atoi(optarg);
+            if (queue_depth < 1 || queue_depth > MAX_QUEUE_DEPTH)
+            {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'r':
+            reject_when_full = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
 
     openlog("aesdsocket", LOG_PID, LOG_USER);
 
@@ -46,14 +117,29 @@ int main(int argc, char *argv[])
     // Setup server socket
     if (setup_server_socket() != 0)
     {
-        cleanup_on_signal();
+        cleanup_server();
         return -1;
     }
 
     if (daemon_mode && daemon(0, 0) == -1)
     {
         syslog(LOG_ERR, "Failed to daemonize");
-        cleanup_on_signal();
+        cleanup_server();
+        return -1;
+    }
+
+    // Connection contexts and receive buffers, reused across clients
+    if (mem_pools_init() != 0)
+    {
+        cleanup_server();
+        return -1;
+    }
+
+    // One descriptor for every write and reply, kept until exit
+    if (data_file_open() != 0)
+    {
+        mem_pools_destroy();
+        cleanup_server();
         return -1;
     }
 
@@ -61,11 +147,41 @@ int main(int argc, char *argv[])
     if (pthread_create(&timer_thread, NULL, timestamp_thread, NULL) != 0)
     {
         syslog(LOG_ERR, "Failed to create timer thread");
-        cleanup_on_signal();
+        data_file_close();
+        mem_pools_destroy();
+        cleanup_server();
         return -1;
     }
 #endif
 
+    if (use_epoll)
+    {
+        int result = event_loop_run(nreactors);
+
+        if (!keep_running)
+        {
+            syslog(LOG_INFO, "Caught signal, exiting");
+        }
+#if !USE_AESD_CHAR_DEVICE
+        timestamp_thread_stop();
+#endif
+        data_file_close();
+        mem_pools_destroy();
+        cleanup_server();
+        return result;
+    }
+
+    if (worker_pool_start(nworkers, queue_depth, reject_when_full) != 0)
+    {
+#if !USE_AESD_CHAR_DEVICE
+        timestamp_thread_stop();
+#endif
+        data_file_close();
+        mem_pools_destroy();
+        cleanup_server();
+        return -1;
+    }
+
     while (keep_running)
     {
         struct sockaddr_in client_addr;
@@ -74,7 +190,8 @@ int main(int argc, char *argv[])
         int client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
         if (client_socket < 0)
         {
-            if (errno == EINTR)
+            // The signal handler shut the socket down to end this loop
+            if (errno == EINTR || !keep_running)
             {
                 continue;
             }
@@ -82,7 +199,7 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        thread_data_t *thread_data = malloc(sizeof(thread_data_t));
+        thread_data_t *thread_data = mem_pool_alloc(&client_pool);
         if (!thread_data)
         {
             syslog(LOG_ERR, "Failed to allocate thread data");
@@ -93,19 +210,22 @@ int main(int argc, char *argv[])
         thread_data->client_socket = client_socket;
         inet_ntop(AF_INET, &client_addr.sin_addr, thread_data->client_ip, INET_ADDRSTRLEN);
 
-        pthread_t thread = {0};
-        if (pthread_create(&thread, NULL, handle_client, thread_data) != 0)
+        if (worker_pool_submit(thread_data) != 0)
         {
-            syslog(LOG_ERR, "Failed to create thread");
-            free(thread_data);
+            syslog(LOG_WARNING, "Worker queue full, rejected connection from %s", thread_data->client_ip);
+            mem_pool_free(&client_pool, thread_data);
             close(client_socket);
-            continue;
         }
-
-        // Cleanup completed threads
-        remove_completed_threads();
     }
 
-    cleanup_on_signal();
+    syslog(LOG_INFO, "Caught signal, exiting");
+    worker_pool_stop();
+#if !USE_AESD_CHAR_DEVICE
+    // Before the data file's mirror goes away under it
+    timestamp_thread_stop();
+#endif
+    data_file_close();
+    mem_pools_destroy();
+    cleanup_server();
     return 0;
 }
@@ -8,6 +8,7 @@
 #include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 
 #define PORT 9000
 #define BUFFER_SIZE 1024
@@ -21,14 +22,6 @@
 #define TIMESTAMP_INTERVAL 10
 #endif
 
-// Thread node structure for managing client threads
-typedef struct thread_node
-{
-    pthread_t thread;
-    struct thread_node *next;
-    int completed;
-} thread_node_t;
-
 // Thread data structure for client handling
 typedef struct
 {
@@ -37,11 +30,10 @@ typedef struct
 } thread_data_t;
 
 // Global variables declarations
-extern volatile sig_atomic_t keep_running;
+// Cleared by the signal handler; atomic because every engine thread polls it
+extern atomic_int keep_running;
 extern int server_socket;
 extern pthread_mutex_t file_mutex;
-extern pthread_mutex_t thread_list_mutex;
-extern thread_node_t *thread_list_head;
 
 #if !USE_AESD_CHAR_DEVICE
 extern pthread_t timer_thread;
@@ -0,0 +1,62 @@
+#ifndef DATA_FILE_H
+#define DATA_FILE_H
+
+#include "../../../aesd-char-driver/aesd_ioctl.h"
+#include "aesd_socket.h"
+#include <sys/types.h>
+
+// Shared descriptor on FILE_PATH, open from data_file_open() to data_file_close()
+extern int data_fd;
+
+// Reply being read from the data file or device, see data_reply_begin()
+struct data_reply
+{
+    // Descriptor read from: data_fd, or one opened for this reply
+    int fd;
+    int owned;
+
+    // Next offset for pread(), -1 to read() at fd's own position
+    off_t pos;
+
+    // File size when the reply started; sendfile() stops there
+    off_t end;
+
+    // Pipe that splice() moves fd's data through, and bytes left in it
+    int pipe_fd[2];
+    size_t pipe_len;
+
+    // Set once fd turned out not to support sendfile() or splice()
+    int copy;
+
+    // Bytes to send before reading fd again: the whole reply fetched by
+    // AESDCHAR_IOCPREAD, or a chunk read from fd when copying
+    char *mem;
+    size_t mem_size;
+    size_t mem_len;
+    size_t mem_off;
+
+    // In-memory mirror of fd, copied from instead of reading fd
+    char *map;
+};
+
+// Open the shared descriptor once at startup, and mirror a regular file in memory; 0 on success
+int data_file_open(void);
+
+// Once no thread appends or replies any more
+void data_file_close(void);
+
+// Append to the data file or device; caller holds file_mutex
+ssize_t data_file_append(const char *buf, size_t len);
+
+// Start a reply with everything stored (seekto NULL) or from a command; 0 on success.
+// Call with file_mutex held: the reply covers what is stored at that point
+int data_reply_begin(struct data_reply *reply, const struct aesd_seekto *seekto);
+
+// Send the next part of the reply to sock; bytes sent, 0 at the end, -1 on error
+// (errno EAGAIN when a non-blocking sock is full). Needs no lock: later
+// appends land past the reply's end
+ssize_t data_reply_send(struct data_reply *reply, int sock);
+
+void data_reply_end(struct data_reply *reply);
+
+#endif // DATA_FILE_H
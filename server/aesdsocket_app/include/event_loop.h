@@ -0,0 +1,15 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "aesd_socket.h"
+
+// Upper bound for the -j reactor count
+#define MAX_REACTORS 64
+
+// Serve clients from nreactors epoll threads until stopped; 0 on clean exit
+int event_loop_run(int nreactors);
+
+// Wake every reactor so event_loop_run() returns; async-signal-safe
+void event_loop_stop(void);
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,50 @@
+#ifndef LINE_FRAMER_H
+#define LINE_FRAMER_H
+
+#include "../../../aesd-char-driver/aesd_ioctl.h"
+#include "aesd_socket.h"
+#include <sys/types.h>
+
+// Longest line buffered whole; longer lines are handed over in parts
+#define MAX_LINE_SIZE (1024 * 1024)
+
+#define SEEKTO_PREFIX "AESDCHAR_IOCSEEKTO:"
+
+// Per-connection receive buffer that splits the byte stream into lines
+struct line_framer
+{
+    char *buf;
+    size_t size;
+
+    // Unconsumed bytes are buf[head, tail); buf[head, scan) has no newline
+    size_t head;
+    size_t scan;
+    size_t tail;
+
+    // The line being received was partly taken by line_framer_flush()
+    int spilled;
+};
+
+int line_framer_init(struct line_framer *f);
+void line_framer_free(struct line_framer *f);
+
+// Free space to receive into; invalidates lines returned so far
+char *line_framer_space(struct line_framer *f, size_t *avail);
+
+// Account for n bytes received into the space
+void line_framer_commit(struct line_framer *f, size_t n);
+
+// Next complete line, newline included; 1 if found, 0 if none yet.
+// continued is set when the start of the line was already flushed
+int line_framer_next(struct line_framer *f, const char **line, size_t *len, int *continued);
+
+// Bytes of the line still waiting for its newline
+size_t line_framer_pending(const struct line_framer *f);
+
+// Take the unterminated line received so far, for a line over MAX_LINE_SIZE or at EOF
+const char *line_framer_flush(struct line_framer *f, size_t *len, int *continued);
+
+// 1 and seekto filled for an "AESDCHAR_IOCSEEKTO:X,Y" line, 0 for other lines, -1 if malformed
+int line_parse_seekto(const char *line, size_t len, struct aesd_seekto *seekto);
+
+#endif // LINE_FRAMER_H
@@ -0,0 +1,47 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include "aesd_socket.h"
+#include <stddef.h>
+#include <time.h>
+
+// Fixed-size objects reused across connections, see mem_pool.c
+struct mem_pool
+{
+    const char *name;
+    size_t obj_size;
+
+    // Objects given back by thread caches, at most max_free of them
+    pthread_mutex_t lock;
+    void *free_list;
+    size_t free_count;
+    size_t max_free;
+
+    // Holds each thread's struct pool_cache
+    pthread_key_t key;
+
+    // Totals of the thread caches' counters, added as they meet the lock
+    unsigned long hits;
+    unsigned long misses;
+
+    // CLOCK_MONOTONIC second from which the next update logs the totals
+    time_t next_report;
+};
+
+// Pools shared by both engines, set up by mem_pools_init()
+extern struct mem_pool client_pool; // thread_data_t
+extern struct mem_pool buffer_pool; // BUFFER_SIZE receive buffers
+
+int mem_pool_init(struct mem_pool *pool, const char *name, size_t obj_size, size_t max_free);
+
+// Log the final hit and miss counts and free every pooled object; other threads must be gone
+void mem_pool_destroy(struct mem_pool *pool);
+
+// An object of obj_size bytes, uninitialized; NULL if out of memory
+void *mem_pool_alloc(struct mem_pool *pool);
+void mem_pool_free(struct mem_pool *pool, void *obj);
+
+int mem_pools_init(void);
+void mem_pools_destroy(void);
+
+#endif // MEM_POOL_H
@@ -6,7 +6,8 @@
 // Initialize signal handlers for the application
 void init_signal_handlers(void);
 
-// Cleanup resources on signal
-void cleanup_on_signal(void);
+// Close the listen socket, destroy file_mutex and remove the data file. Called
+// once, by main() on its way out, after the engines and the timestamp thread stopped
+void cleanup_server(void);
 
 #endif // SIGNAL_HANDLER_H
@@ -5,12 +5,12 @@
 
 // Thread management functions
 void *handle_client(void *arg);
-thread_node_t *add_thread_to_list(pthread_t thread);
-void remove_completed_threads(void);
-void cleanup_thread_list(void);
 
 #if !USE_AESD_CHAR_DEVICE
 void *timestamp_thread(void *arg);
+
+// Cancel and join the timestamp thread, if it is running
+void timestamp_thread_stop(void);
 #endif
 
 #endif // THREAD_MANAGER_H
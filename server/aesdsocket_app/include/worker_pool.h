@@ -0,0 +1,23 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "aesd_socket.h"
+
+// Defaults for -w and -q
+#define DEFAULT_WORKERS 8
+#define DEFAULT_QUEUE_DEPTH 64
+
+// Upper bounds for -w and -q
+#define MAX_WORKERS 1024
+#define MAX_QUEUE_DEPTH 65536
+
+// Start nworkers threads serving a queue of up to queue_depth accepted clients
+int worker_pool_start(int nworkers, int queue_depth, int reject_when_full);
+
+// Queue a client for handle_client(); -1 if rejected, the caller still owns data
+int worker_pool_submit(thread_data_t *data);
+
+// Drop queued clients, end active ones and join every worker
+void worker_pool_stop(void);
+
+#endif // WORKER_POOL_H
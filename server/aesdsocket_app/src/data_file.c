@@ -0,0 +1,590 @@
+#define _GNU_SOURCE // pipe2, splice
+#include "../include/data_file.h"
+#include "../include/socket_ops.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <syslog.h>
+#include <unistd.h>
+
+/**
+ * Long-lived access to FILE_PATH, replacing an open()/close() per received
+ * chunk and per reply.
+ *
+ * One descriptor, opened at startup, takes every write (O_APPEND for the
+ * regular file) and serves replies without touching its file position:
+ * - Regular file: sendfile() from offset 0 up to the size seen when the
+ *   reply started; the file is append-only, so those bytes never change
+ * - aesdchar device: AESDCHAR_IOCPREAD, one ioctl copying the whole reply,
+ *   which is then sent straight from that buffer
+ * Either way the reply is fixed by data_reply_begin(), under file_mutex,
+ * and sent without it, so a slow client never holds up other writers.
+ * Devices without AESDCHAR_IOCPREAD (the CUSE daemon) ignore read offsets,
+ * so their replies still open a descriptor and splice() it from the start.
+ *
+ * When sendfile() or splice() is not supported by the source, the reply is
+ * copied through a REPLY_COPY_SIZE buffer instead.
+ *
+ * The regular file is mapped shared over MIRROR_WINDOW bytes of address
+ * space, reserved once so the mapping never moves under replies in flight.
+ * Appends are memcpy()s into it rather than a write() each, and the size it
+ * tracks ends replies without an fstat(). Replies still leave by sendfile():
+ * the mapped pages are the file's page cache, so it sends them as they are,
+ * where send() from the mapping would copy them into the socket. Only when
+ * sendfile() is unsupported are they sent from the mapping, instead of the
+ * pread() copy.
+ *
+ * The file grows in steps of up to MIRROR_STEP_MAX bytes, allocated with
+ * posix_fallocate() so a full disk fails the append instead of faulting on
+ * the mapping, and faulted in at once. The zero padding this leaves past
+ * the data is trimmed by data_file_close(). Before each step the data size
+ * is recorded in the MIRROR_XATTR attribute, removed again once the file is
+ * trimmed, so at startup a file without it is taken whole, NUL bytes
+ * included. Only past the recorded size, where an unclean exit left
+ * padding, are trailing NULs dropped; NUL bytes at the very end of the
+ * data appended since that step are lost with them. A file that outgrows
+ * the window, or a failure to record or grow it, falls back to write() and
+ * fstat().
+ */
+
+// First AESDCHAR_IOCPREAD buffer; grown to what the driver reports
+#define REPLY_INITIAL_SIZE (16 * BUFFER_SIZE)
+
+// Bytes moved per splice() into the pipe, and per read() when copying
+#define REPLY_PIPE_SIZE (64 * BUFFER_SIZE)
+#define REPLY_COPY_SIZE (64 * BUFFER_SIZE)
+
+#if !USE_AESD_CHAR_DEVICE
+// Address space reserved for the mirror
+#if UINTPTR_MAX > 0xffffffffu
+#define MIRROR_WINDOW ((size_t)1 << 32)
+#else
+#define MIRROR_WINDOW ((size_t)1 << 28)
+#endif
+
+// The file grows by its own size, in whole MIRROR_CHUNKs, at most MIRROR_STEP_MAX
+#define MIRROR_CHUNK ((size_t)1024 * BUFFER_SIZE)
+#define MIRROR_STEP_MAX (16 * MIRROR_CHUNK)
+
+// Data size when the file was last grown, present while it may hold padding
+#define MIRROR_XATTR "user.aesdsocket.data_size"
+
+// In-memory mirror of the data file; written under file_mutex
+static struct
+{
+    char *map;        // MIRROR_WINDOW bytes mapped over the file, NULL if not mapped
+    int active;       // Appends and replies go through map
+    size_t data_size; // Bytes of data in the file
+    size_t file_size; // Bytes the file has been grown to; zero padding past data_size
+} mirror;
+#endif
+
+int data_fd = -1;
+
+#if !USE_AESD_CHAR_DEVICE
+// Bytes of data the file is known to hold: all of it, unless a growth step recorded less
+static size_t mirror_known_size(size_t file_size)
+{
+    char value[32];
+    ssize_t len;
+    size_t size;
+
+    len = fgetxattr(data_fd, MIRROR_XATTR, value, sizeof(value) - 1);
+    if (len < 0)
+    {
+        if (errno != ENODATA && errno != ENOTSUP)
+        {
+            syslog(LOG_WARNING, "Failed to read %s of %s: %s", MIRROR_XATTR, FILE_PATH, strerror(errno));
+        }
+        return file_size;
+    }
+    value[len] = '\0';
+    size = strtoull(value, NULL, 10);
+    return size < file_size ? size : file_size;
+}
+
+static void mirror_open(void)
+{
+    struct stat st;
+    size_t known;
+    char *map;
+
+    if (fstat(data_fd, &st) == -1)
+    {
+        syslog(LOG_WARNING, "Failed to stat %s, not mirroring it: %s", FILE_PATH, strerror(errno));
+        return;
+    }
+    if ((uintmax_t)st.st_size > MIRROR_WINDOW)
+    {
+        syslog(LOG_WARNING, "%s is too large to mirror", FILE_PATH);
+        return;
+    }
+
+    map = mmap(NULL, MIRROR_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, data_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        syslog(LOG_WARNING, "Failed to map %s, not mirroring it: %s", FILE_PATH, strerror(errno));
+        return;
+    }
+
+    mirror.map = map;
+    mirror.active = 1;
+    mirror.file_size = st.st_size;
+    mirror.data_size = st.st_size;
+
+    // Padding left by a run that did not reach data_file_close()
+    known = mirror_known_size(st.st_size);
+    while (mirror.data_size > known && !map[mirror.data_size - 1])
+    {
+        mirror.data_size--;
+    }
+    if (mirror.data_size)
+    {
+        syslog(LOG_INFO, "Mirrored %zu bytes already in %s", mirror.data_size, FILE_PATH);
+    }
+}
+
+// Switch to write() and sendfile(); the mapping stays for replies in flight
+static void mirror_drop(void)
+{
+    mirror.active = 0;
+    if (ftruncate(data_fd, mirror.data_size) == -1)
+    {
+        syslog(LOG_ERR, "Failed to trim %s: %s", FILE_PATH, strerror(errno));
+        return;
+    }
+    if (fremovexattr(data_fd, MIRROR_XATTR) == -1 && errno != ENODATA && errno != ENOTSUP)
+    {
+        syslog(LOG_WARNING, "Failed to remove %s of %s: %s", MIRROR_XATTR, FILE_PATH, strerror(errno));
+    }
+}
+
+// Record where the padding of the next step starts; 0 on success
+static int mirror_mark(void)
+{
+    char value[32];
+    int len = snprintf(value, sizeof(value), "%zu", mirror.data_size);
+
+    if (fsetxattr(data_fd, MIRROR_XATTR, value, len, 0) == -1)
+    {
+        syslog(LOG_WARNING, "Failed to set %s on %s, writing it directly: %s", MIRROR_XATTR, FILE_PATH,
+               strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Make room for len more bytes in the file; -1 after dropping the mirror
+static int mirror_reserve(size_t len)
+{
+    size_t need = mirror.data_size + len;
+    size_t step = mirror.file_size;
+    size_t size;
+    int err;
+
+    if (need <= mirror.file_size)
+    {
+        return 0;
+    }
+    if (need > MIRROR_WINDOW)
+    {
+        syslog(LOG_WARNING, "%s outgrew its mirror, writing it directly", FILE_PATH);
+        mirror_drop();
+        return -1;
+    }
+
+    // Fewer, larger steps as the file grows: each one costs a fallocate() and a populate
+    if (step > MIRROR_STEP_MAX)
+    {
+        step = MIRROR_STEP_MAX;
+    }
+    size = mirror.file_size + step > need ? mirror.file_size + step : need;
+    size = (size + MIRROR_CHUNK - 1) / MIRROR_CHUNK * MIRROR_CHUNK;
+    if (size > MIRROR_WINDOW)
+    {
+        size = MIRROR_WINDOW;
+    }
+
+    // Without the mark, padding left by an unclean exit would read back as data
+    if (mirror_mark() == -1)
+    {
+        mirror_drop();
+        return -1;
+    }
+
+    err = posix_fallocate(data_fd, mirror.data_size, size - mirror.data_size);
+    if (err != 0)
+    {
+        syslog(LOG_ERR, "Failed to grow %s, writing it directly: %s", FILE_PATH, strerror(err));
+        mirror_drop();
+        return -1;
+    }
+#ifdef MADV_POPULATE_WRITE
+    // Fault the new step in with one call rather than a page at a time
+    madvise(mirror.map + mirror.file_size, size - mirror.file_size, MADV_POPULATE_WRITE);
+#endif
+    mirror.file_size = size;
+    return 0;
+}
+
+static void mirror_close(void)
+{
+    if (!mirror.map)
+    {
+        return;
+    }
+    if (mirror.active)
+    {
+        mirror_drop();
+    }
+    munmap(mirror.map, MIRROR_WINDOW);
+    memset(&mirror, 0, sizeof(mirror));
+}
+#endif
+
+int data_file_open(void)
+{
+#if USE_AESD_CHAR_DEVICE
+    data_fd = open(FILE_PATH, O_RDWR | O_CLOEXEC);
+#else
+    data_fd = open(FILE_PATH, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, FILE_PERMISSIONS);
+#endif
+    if (data_fd == -1)
+    {
+        syslog(LOG_ERR, "Failed to open %s: %s", FILE_PATH, strerror(errno));
+        return -1;
+    }
+#if !USE_AESD_CHAR_DEVICE
+    mirror_open();
+#endif
+    return 0;
+}
+
+// Every appender and reply must be done: the mirror is unmapped
+void data_file_close(void)
+{
+    if (data_fd != -1)
+    {
+#if !USE_AESD_CHAR_DEVICE
+        mirror_close();
+#endif
+        close(data_fd);
+        data_fd = -1;
+    }
+}
+
+ssize_t data_file_append(const char *buf, size_t len)
+{
+#if !USE_AESD_CHAR_DEVICE
+    if (mirror.active && mirror_reserve(len) == 0)
+    {
+        memcpy(mirror.map + mirror.data_size, buf, len);
+        mirror.data_size += len;
+        return len;
+    }
+#endif
+    return write_all(data_fd, buf, len);
+}
+
+#if USE_AESD_CHAR_DEVICE
+/**
+ * Fetch the whole reply with AESDCHAR_IOCPREAD
+ *
+ * Returns 0 on success, 1 if the device lacks the ioctl, -1 on error.
+ */
+static int reply_fetch(struct data_reply *reply, const struct aesd_seekto *seekto)
+{
+    struct aesd_pread pr = {.write_cmd = seekto->write_cmd, .write_cmd_offset = seekto->write_cmd_offset};
+    size_t size = REPLY_INITIAL_SIZE;
+    char *mem = NULL;
+
+    for (;;)
+    {
+        char *grown = realloc(mem, size);
+
+        if (!grown)
+        {
+            syslog(LOG_ERR, "Failed to allocate %zu byte reply buffer", size);
+            free(mem);
+            return -1;
+        }
+        mem = grown;
+        pr.buf_ptr = (uintptr_t)mem;
+        pr.buf_len = size;
+
+        if (ioctl(data_fd, AESDCHAR_IOCPREAD, &pr) == -1)
+        {
+            free(mem);
+            return errno == ENOTTY ? 1 : -1;
+        }
+        if (pr.bytes_copied >= pr.bytes_available)
+        {
+            break;
+        }
+        // Grow to what the driver reported; writers may add more meanwhile, so loop
+        size = pr.bytes_available;
+    }
+
+    reply->mem = mem;
+    reply->mem_size = size;
+    reply->mem_len = pr.bytes_copied;
+    return 0;
+}
+#endif
+
+static void reply_reset(struct data_reply *reply)
+{
+    memset(reply, 0, sizeof(*reply));
+    reply->fd = -1;
+    reply->pos = -1;
+    reply->pipe_fd[0] = -1;
+    reply->pipe_fd[1] = -1;
+}
+
+int data_reply_begin(struct data_reply *reply, const struct aesd_seekto *seekto)
+{
+    reply_reset(reply);
+
+#if USE_AESD_CHAR_DEVICE
+    {
+        const struct aesd_seekto start = {0, 0};
+        int ret = reply_fetch(reply, seekto ? seekto : &start);
+
+        if (ret == 0)
+        {
+            return 0;
+        }
+        if (ret == -1)
+        {
+            // Command 0 does not exist when the device is empty: nothing to send
+            if (!seekto && errno == EINVAL)
+            {
+                return 0;
+            }
+            syslog(LOG_ERR, "IOCTL error: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    // No AESDCHAR_IOCPREAD: a fresh descriptor starts at the oldest command
+    reply->fd = open(FILE_PATH, O_RDONLY | O_CLOEXEC);
+    if (reply->fd == -1)
+    {
+        syslog(LOG_ERR, "Failed to open file: %s", strerror(errno));
+        return -1;
+    }
+    reply->owned = 1;
+
+    if (seekto && ioctl(reply->fd, AESDCHAR_IOCSEEKTO, seekto) == -1)
+    {
+        syslog(LOG_ERR, "IOCTL error: %s", strerror(errno));
+        data_reply_end(reply);
+        return -1;
+    }
+#else
+    struct stat st;
+
+    (void)seekto;
+    if (mirror.active)
+    {
+        // The mirror's pages are the file's page cache: sendfile() takes them as they are
+        reply->fd = data_fd;
+        reply->pos = 0;
+        reply->end = mirror.data_size;
+        reply->map = mirror.map;
+        return 0;
+    }
+    if (fstat(data_fd, &st) == -1)
+    {
+        syslog(LOG_ERR, "Failed to stat %s: %s", FILE_PATH, strerror(errno));
+        return -1;
+    }
+    reply->fd = data_fd;
+    reply->pos = 0;
+    reply->end = st.st_size;
+#endif
+    return 0;
+}
+
+/**
+ * Refill mem from fd, or point it at the mirror, for sources without
+ * sendfile() or splice()
+ *
+ * Returns the bytes read, 0 at the end, -1 on error (logged).
+ */
+static ssize_t reply_copy(struct data_reply *reply)
+{
+    size_t len = REPLY_COPY_SIZE;
+    ssize_t n;
+
+    if (reply->map)
+    {
+        // Mirrored: the rest of the reply is already in memory
+        reply->mem = reply->map + reply->pos;
+        reply->mem_off = 0;
+        reply->mem_len = reply->end - reply->pos;
+        reply->pos = reply->end;
+        return reply->mem_len;
+    }
+    if (!reply->mem_size)
+    {
+        reply->mem = malloc(REPLY_COPY_SIZE);
+        if (!reply->mem)
+        {
+            syslog(LOG_ERR, "Failed to allocate %d byte reply buffer", REPLY_COPY_SIZE);
+            return -1;
+        }
+        reply->mem_size = REPLY_COPY_SIZE;
+    }
+    if (reply->pos != -1 && (off_t)len > reply->end - reply->pos)
+    {
+        len = reply->end - reply->pos;
+    }
+
+    do
+    {
+        n = reply->pos == -1 ? read(reply->fd, reply->mem, len) : pread(reply->fd, reply->mem, len, reply->pos);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+    {
+        syslog(LOG_ERR, "Read error: %s", strerror(errno));
+        return -1;
+    }
+    if (reply->pos != -1)
+    {
+        reply->pos += n;
+    }
+    reply->mem_off = 0;
+    reply->mem_len = n;
+    return n;
+}
+
+/**
+ * Move the next part of fd to sock without copying it through userspace:
+ * sendfile() for the data file, splice() through a pipe for a device
+ *
+ * Returns the bytes sent, 0 at the end, -1 with errno set. EINVAL or
+ * ENOSYS from the source set reply->copy for the caller to retry.
+ */
+static ssize_t reply_zero_copy(struct data_reply *reply, int sock)
+{
+    ssize_t n;
+
+    if (reply->pos != -1)
+    {
+        if (reply->pos >= reply->end)
+        {
+            return 0;
+        }
+        n = sendfile(sock, reply->fd, &reply->pos, reply->end - reply->pos);
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            reply->copy = 1;
+        }
+        return n;
+    }
+
+    if (reply->pipe_fd[0] == -1 && pipe2(reply->pipe_fd, O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        syslog(LOG_ERR, "Failed to create reply pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    if (!reply->pipe_len)
+    {
+        n = splice(reply->fd, NULL, reply->pipe_fd[1], NULL, REPLY_PIPE_SIZE, SPLICE_F_MOVE);
+        if (n <= 0)
+        {
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+            {
+                reply->copy = 1;
+            }
+            return n;
+        }
+        reply->pipe_len = n;
+    }
+
+    n = splice(reply->pipe_fd[0], NULL, sock, NULL, reply->pipe_len, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n > 0)
+    {
+        reply->pipe_len -= n;
+    }
+    return n;
+}
+
+ssize_t data_reply_send(struct data_reply *reply, int sock)
+{
+    for (;;)
+    {
+        ssize_t n;
+
+        if (reply->mem_off < reply->mem_len)
+        {
+            n = send(sock, reply->mem + reply->mem_off, reply->mem_len - reply->mem_off, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                reply->mem_off += n;
+            }
+        }
+        else if (reply->fd == -1)
+        {
+            return 0;
+        }
+        else if (reply->copy)
+        {
+            n = reply_copy(reply);
+            if (n > 0)
+            {
+                continue;
+            }
+            return n;
+        }
+        else
+        {
+            n = reply_zero_copy(reply, sock);
+            if (n < 0 && reply->copy)
+            {
+                continue;
+            }
+        }
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            syslog(LOG_ERR, "Send error: %s", strerror(errno));
+        }
+        return n;
+    }
+}
+
+void data_reply_end(struct data_reply *reply)
+{
+    if (reply->owned)
+    {
+        close(reply->fd);
+    }
+    if (reply->pipe_fd[0] != -1)
+    {
+        close(reply->pipe_fd[0]);
+        close(reply->pipe_fd[1]);
+    }
+    // Otherwise mem points into the mirror
+    if (!reply->map)
+    {
+        free(reply->mem);
+    }
+    reply_reset(reply);
+}
@@ -0,0 +1,536 @@
+#define _GNU_SOURCE // accept4
+#include "../include/event_loop.h"
+#include "../include/data_file.h"
+#include "../include/line_framer.h"
+#include "../include/mem_pool.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+/**
+ * Alternative to one thread per client: non-blocking sockets served by
+ * epoll reactors. Each reactor owns an epoll instance and the connections
+ * it accepted; with more than one, they share the listening socket through
+ * EPOLLEXCLUSIVE so a new connection wakes a single reactor.
+ *
+ * Connections follow the same protocol as handle_client(), one line at a
+ * time:
+ * - CONN_RECV: wait for data; each complete line is appended to the data
+ *   file, or an AESDCHAR_IOCSEEKTO:X,Y line starts a reply from that
+ *   device position
+ * - CONN_SEND: stream the reply with data_reply_send(), resuming on
+ *   EPOLLOUT whenever the socket is full; afterwards the next received
+ *   line is handled, and once none is left the connection closes (after
+ *   a data line or EOF) or returns to CONN_RECV
+ *
+ * file_mutex covers the write and data_reply_begin(), as in the threaded
+ * engine, but not the streaming: a reactor must never wait on a client
+ * while holding it.
+ */
+
+#define EVENT_BATCH 64
+
+enum conn_state
+{
+    CONN_RECV,
+    CONN_SEND,
+};
+
+// Per-connection state machine
+struct conn
+{
+    int fd;
+    char client_ip[INET_ADDRSTRLEN];
+    enum conn_state state;
+
+    // Received bytes, split into lines
+    struct line_framer framer;
+    int eof;
+
+    // Reply streamed until its end while replying is set
+    struct data_reply reply;
+    int replying;
+    int close_after_reply;
+
+    // Reactor's list of open connections, for shutdown
+    struct conn *prev;
+    struct conn *next;
+};
+
+struct reactor
+{
+    pthread_t thread;
+    int epoll_fd;
+    struct conn *conns;
+};
+
+// Connection contexts, reused across clients while event_loop_run() runs
+static struct mem_pool conn_pool;
+
+// eventfd written by event_loop_stop(), level-triggered in every reactor. Never
+// closed: the signal handler may write it at any time until the process exits
+static atomic_int stop_fd = -1;
+
+// epoll_event.data.ptr markers for the two non-connection descriptors
+static char listen_marker;
+static char stop_marker;
+
+static void conn_close(struct reactor *r, struct conn *c)
+{
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->replying)
+    {
+        data_reply_end(&c->reply);
+    }
+
+    if (c->prev)
+    {
+        c->prev->next = c->next;
+    }
+    else
+    {
+        r->conns = c->next;
+    }
+    if (c->next)
+    {
+        c->next->prev = c->prev;
+    }
+
+    syslog(LOG_INFO, "Closed connection from %s", c->client_ip);
+    line_framer_free(&c->framer);
+    mem_pool_free(&conn_pool, c);
+}
+
+static int conn_watch(struct reactor *r, struct conn *c, int op, uint32_t events)
+{
+    struct epoll_event ev = {.events = events, .data.ptr = c};
+
+    return epoll_ctl(r->epoll_fd, op, c->fd, &ev);
+}
+
+/**
+ * Send the pending reply until it ends or the socket is full
+ *
+ * Returns 1 when the reply is complete, 0 when the socket is full (the
+ * caller waits for EPOLLOUT), -1 on error.
+ */
+static int conn_flush(struct conn *c)
+{
+    ssize_t n;
+
+    while (c->replying)
+    {
+        n = data_reply_send(&c->reply, c->fd);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (n <= 0)
+        {
+            data_reply_end(&c->reply);
+            c->replying = 0;
+            if (n < 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Handle one line, like handle_line() in the threaded engine
+ *
+ * complete is 0 for part of an overlong line or an unterminated last
+ * line: data is stored without a reply. Returns 0 with replying set when
+ * a reply is due, 0 with replying clear when not, -1 to drop the connection.
+ */
+static int conn_process_line(struct conn *c, const char *line, size_t len, int continued, int complete)
+{
+    struct aesd_seekto seekto;
+    // Only a whole, newline-terminated line can be a seek command
+    int seek = continued || !complete ? 0 : line_parse_seekto(line, len, &seekto);
+    int result = 0;
+
+    if (seek == -1)
+    {
+        syslog(LOG_ERR, "Invalid AESDCHAR_IOCSEEKTO format, expected X,Y");
+        return -1;
+    }
+    if (seek == 1)
+    {
+#if USE_AESD_CHAR_DEVICE
+        pthread_mutex_lock(&file_mutex);
+        result = data_reply_begin(&c->reply, &seekto);
+        pthread_mutex_unlock(&file_mutex);
+        if (result == -1)
+        {
+            return -1;
+        }
+        c->replying = 1;
+#endif
+        return 0;
+    }
+
+    pthread_mutex_lock(&file_mutex);
+
+    if (data_file_append(line, len) != (ssize_t)len)
+    {
+        syslog(LOG_ERR, "Write error: %s", strerror(errno));
+        result = -1;
+        goto out;
+    }
+
+    // A complete command: reply with everything stored, then close
+    if (complete)
+    {
+        result = data_reply_begin(&c->reply, NULL);
+        if (result == -1)
+        {
+            goto out;
+        }
+        c->replying = 1;
+        c->close_after_reply = 1;
+    }
+
+out:
+    pthread_mutex_unlock(&file_mutex);
+    return result;
+}
+
+/**
+ * Handle the next received line, if any
+ *
+ * Returns 1 after handling one, 0 when no complete line is buffered, -1
+ * to drop the connection. Lines over MAX_LINE_SIZE are handled in parts,
+ * and whatever is left at EOF as a last line.
+ */
+static int conn_next_line(struct conn *c)
+{
+    const char *line;
+    size_t len;
+    int continued;
+
+    if (line_framer_next(&c->framer, &line, &len, &continued))
+    {
+        return conn_process_line(c, line, len, continued, 1) == -1 ? -1 : 1;
+    }
+    if (line_framer_pending(&c->framer) >= MAX_LINE_SIZE || (c->eof && line_framer_pending(&c->framer)))
+    {
+        line = line_framer_flush(&c->framer, &len, &continued);
+        return conn_process_line(c, line, len, continued, 0) == -1 ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Send pending replies and handle received lines in turn, until the socket
+ * is full or every line is done; then close or wait for more data
+ */
+static void conn_run(struct reactor *r, struct conn *c)
+{
+    for (;;)
+    {
+        int ret = conn_flush(c);
+
+        if (ret == 0)
+        {
+            if (c->state != CONN_SEND)
+            {
+                c->state = CONN_SEND;
+                conn_watch(r, c, EPOLL_CTL_MOD, EPOLLOUT);
+            }
+            return;
+        }
+        if (ret == 1)
+        {
+            ret = conn_next_line(c);
+        }
+        if (ret == -1)
+        {
+            conn_close(r, c);
+            return;
+        }
+        if (ret == 0)
+        {
+            break;
+        }
+    }
+
+    if (c->close_after_reply || c->eof)
+    {
+        conn_close(r, c);
+        return;
+    }
+    if (c->state != CONN_RECV)
+    {
+        c->state = CONN_RECV;
+        conn_watch(r, c, EPOLL_CTL_MOD, EPOLLIN);
+    }
+}
+
+static void conn_on_readable(struct reactor *r, struct conn *c)
+{
+    size_t avail;
+    char *space = line_framer_space(&c->framer, &avail);
+    ssize_t n;
+
+    if (!space)
+    {
+        conn_close(r, c);
+        return;
+    }
+
+    n = recv(c->fd, space, avail, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        return;
+    }
+    if (n < 0)
+    {
+        conn_close(r, c);
+        return;
+    }
+
+    if (n == 0)
+    {
+        c->eof = 1;
+    }
+    line_framer_commit(&c->framer, n);
+    conn_run(r, c);
+}
+
+// Accept every pending connection; other reactors may take some first
+static void reactor_accept(struct reactor *r)
+{
+    for (;;)
+    {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        struct conn *c;
+        int client_socket =
+            accept4(server_socket, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client_socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                syslog(LOG_ERR, "Accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+
+        c = mem_pool_alloc(&conn_pool);
+        if (c)
+        {
+            memset(c, 0, sizeof(*c));
+        }
+        if (!c || line_framer_init(&c->framer) == -1)
+        {
+            syslog(LOG_ERR, "Failed to allocate connection");
+            mem_pool_free(&conn_pool, c);
+            close(client_socket);
+            continue;
+        }
+
+        c->fd = client_socket;
+        c->state = CONN_RECV;
+        inet_ntop(AF_INET, &client_addr.sin_addr, c->client_ip, INET_ADDRSTRLEN);
+
+        if (conn_watch(r, c, EPOLL_CTL_ADD, EPOLLIN) == -1)
+        {
+            syslog(LOG_ERR, "epoll_ctl failed: %s", strerror(errno));
+            close(client_socket);
+            line_framer_free(&c->framer);
+            mem_pool_free(&conn_pool, c);
+            continue;
+        }
+
+        c->next = r->conns;
+        if (r->conns)
+        {
+            r->conns->prev = c;
+        }
+        r->conns = c;
+        syslog(LOG_INFO, "Accepted connection from %s", c->client_ip);
+    }
+}
+
+static void *reactor_run(void *arg)
+{
+    struct reactor *r = arg;
+    struct epoll_event events[EVENT_BATCH];
+
+    while (keep_running)
+    {
+        int n = epoll_wait(r->epoll_fd, events, EVENT_BATCH, -1);
+        int i;
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            syslog(LOG_ERR, "epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            void *ptr = events[i].data.ptr;
+            struct conn *c = ptr;
+
+            if (ptr == &stop_marker)
+            {
+                goto out;
+            }
+            if (ptr == &listen_marker)
+            {
+                reactor_accept(r);
+                continue;
+            }
+
+            if (c->state == CONN_SEND && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                conn_run(r, c);
+            }
+            else if (c->state == CONN_RECV && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            {
+                conn_on_readable(r, c);
+            }
+        }
+    }
+
+out:
+    while (r->conns)
+    {
+        conn_close(r, r->conns);
+    }
+    return NULL;
+}
+
+static int reactor_init(struct reactor *r, int exclusive)
+{
+    struct epoll_event listen_ev = {.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0), .data.ptr = &listen_marker};
+    struct epoll_event stop_ev = {.events = EPOLLIN, .data.ptr = &stop_marker};
+
+    r->conns = NULL;
+    r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epoll_fd == -1)
+    {
+        syslog(LOG_ERR, "epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, server_socket, &listen_ev) == -1 ||
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, stop_fd, &stop_ev) == -1)
+    {
+        syslog(LOG_ERR, "epoll_ctl failed: %s", strerror(errno));
+        close(r->epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void event_loop_stop(void)
+{
+    uint64_t one = 1;
+    int fd = stop_fd;
+
+    if (fd != -1 && write(fd, &one, sizeof(one)) < 0)
+    {
+        // Nothing to do from a signal handler; keep_running is cleared too
+    }
+}
+
+int event_loop_run(int nreactors)
+{
+    static struct reactor reactors[MAX_REACTORS];
+    int started = 0;
+    int result = 0;
+    int i;
+
+    if (nreactors < 1 || nreactors > MAX_REACTORS)
+    {
+        syslog(LOG_ERR, "Reactor count must be 1 to %d", MAX_REACTORS);
+        return -1;
+    }
+
+    if (fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        syslog(LOG_ERR, "Failed to make the server socket non-blocking: %s", strerror(errno));
+        return -1;
+    }
+
+    if (mem_pool_init(&conn_pool, "connection", sizeof(struct conn), 1024) == -1)
+    {
+        return -1;
+    }
+
+    if (stop_fd == -1)
+    {
+        int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if (fd == -1)
+        {
+            syslog(LOG_ERR, "eventfd failed: %s", strerror(errno));
+            mem_pool_destroy(&conn_pool);
+            return -1;
+        }
+        stop_fd = fd;
+    }
+
+    // Reactor 0 runs on the calling thread
+    for (i = 0; i < nreactors; i++)
+    {
+        if (reactor_init(&reactors[i], nreactors > 1) == -1)
+        {
+            result = -1;
+            break;
+        }
+        if (i > 0 && pthread_create(&reactors[i].thread, NULL, reactor_run, &reactors[i]) != 0)
+        {
+            syslog(LOG_ERR, "Failed to create reactor thread");
+            close(reactors[i].epoll_fd);
+            result = -1;
+            break;
+        }
+        started++;
+    }
+
+    if (result == 0)
+    {
+        reactor_run(&reactors[0]);
+    }
+    else
+    {
+        event_loop_stop();
+    }
+
+    for (i = 0; i < started; i++)
+    {
+        if (i > 0)
+        {
+            pthread_join(reactors[i].thread, NULL);
+        }
+        close(reactors[i].epoll_fd);
+    }
+
+    mem_pool_destroy(&conn_pool);
+    return result;
+}
@@ -0,0 +1,158 @@
+#include "../include/line_framer.h"
+#include "../include/mem_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+/**
+ * Splits a connection's byte stream into newline-terminated commands,
+ * however recv() happens to cut it: a chunk may hold several lines, and a
+ * line may span many chunks.
+ *
+ * Received bytes are appended at tail. Each byte is searched for a newline
+ * once, scan remembering where the last search stopped, and complete lines
+ * are handed out in place. The buffer is compacted or doubled only when
+ * fewer than LINE_MIN_SPACE bytes are free, so its size stays around
+ * MAX_LINE_SIZE at most: the caller flushes longer lines.
+ *
+ * The first buffer is a BUFFER_SIZE block from buffer_pool; only lines
+ * that outgrow it move to malloc()ed memory.
+ */
+
+// Free space below which line_framer_space() compacts or grows the buffer
+#define LINE_MIN_SPACE (BUFFER_SIZE / 4)
+
+// Digits of two unsigned ints, a comma and a newline, with room to spare
+#define SEEKTO_ARGS_MAX 32
+
+int line_framer_init(struct line_framer *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->buf = mem_pool_alloc(&buffer_pool);
+    if (!f->buf)
+    {
+        syslog(LOG_ERR, "Failed to allocate buffer");
+        return -1;
+    }
+    f->size = BUFFER_SIZE;
+    return 0;
+}
+
+void line_framer_free(struct line_framer *f)
+{
+    if (f->size == BUFFER_SIZE)
+    {
+        mem_pool_free(&buffer_pool, f->buf);
+    }
+    else
+    {
+        free(f->buf);
+    }
+    memset(f, 0, sizeof(*f));
+}
+
+char *line_framer_space(struct line_framer *f, size_t *avail)
+{
+    if (f->size - f->tail < LINE_MIN_SPACE && f->head)
+    {
+        memmove(f->buf, f->buf + f->head, f->tail - f->head);
+        f->scan -= f->head;
+        f->tail -= f->head;
+        f->head = 0;
+    }
+    if (f->size - f->tail < LINE_MIN_SPACE)
+    {
+        char *grown = f->size == BUFFER_SIZE ? malloc(f->size * 2) : realloc(f->buf, f->size * 2);
+
+        if (!grown)
+        {
+            syslog(LOG_ERR, "Failed to grow line buffer to %zu bytes", f->size * 2);
+            return NULL;
+        }
+        if (f->size == BUFFER_SIZE)
+        {
+            memcpy(grown, f->buf, f->tail);
+            mem_pool_free(&buffer_pool, f->buf);
+        }
+        f->buf = grown;
+        f->size *= 2;
+    }
+
+    *avail = f->size - f->tail;
+    return f->buf + f->tail;
+}
+
+void line_framer_commit(struct line_framer *f, size_t n)
+{
+    f->tail += n;
+}
+
+int line_framer_next(struct line_framer *f, const char **line, size_t *len, int *continued)
+{
+    char *newline = memchr(f->buf + f->scan, '\n', f->tail - f->scan);
+
+    if (!newline)
+    {
+        f->scan = f->tail;
+        return 0;
+    }
+
+    *line = f->buf + f->head;
+    *len = newline + 1 - *line;
+    *continued = f->spilled;
+    f->spilled = 0;
+
+    f->head = f->scan = newline + 1 - f->buf;
+    if (f->head == f->tail)
+    {
+        f->head = f->scan = f->tail = 0;
+    }
+    return 1;
+}
+
+size_t line_framer_pending(const struct line_framer *f)
+{
+    return f->tail - f->head;
+}
+
+const char *line_framer_flush(struct line_framer *f, size_t *len, int *continued)
+{
+    const char *line = f->buf + f->head;
+
+    *len = f->tail - f->head;
+    *continued = f->spilled;
+    f->spilled = 1;
+    f->head = f->scan = f->tail = 0;
+    return line;
+}
+
+int line_parse_seekto(const char *line, size_t len, struct aesd_seekto *seekto)
+{
+    const size_t prefix_len = sizeof(SEEKTO_PREFIX) - 1;
+    char args[SEEKTO_ARGS_MAX + 1];
+
+    if (len < prefix_len || memcmp(line, SEEKTO_PREFIX, prefix_len) != 0)
+    {
+        return 0;
+    }
+
+    /**
+     * Parse X,Y from the command string
+     * X = write_cmd (command index, 0-based)
+     * Y = write_cmd_offset (byte offset within that command)
+     */
+    len -= prefix_len;
+    if (len > SEEKTO_ARGS_MAX)
+    {
+        return -1;
+    }
+    memcpy(args, line + prefix_len, len);
+    args[len] = '\0';
+
+    if (sscanf(args, "%u,%u", &seekto->write_cmd, &seekto->write_cmd_offset) != 2)
+    {
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,295 @@
+#include "../include/mem_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+/**
+ * Slab-style pools of fixed-size objects, so connection churn reuses the
+ * same contexts and buffers instead of going through malloc()/free().
+ *
+ * Each thread keeps a small cache of free objects, reached through a
+ * pthread key, and allocates and frees from it without locking. The pool
+ * lock is taken only to move POOL_CACHE_BATCH objects between a cache and
+ * the shared free list: when a cache runs empty, when it overflows, and
+ * when its thread exits. That matters because objects often change hands,
+ * e.g. the accept loop allocates every thread_data_t and workers free them.
+ *
+ * A hit is an allocation served from the pool, a miss one that needed
+ * malloc(). Caches count both privately and add them to the pool totals
+ * whenever they take the lock, and at least every POOL_COUNT_BATCH
+ * allocations, since a thread that frees what it allocates never needs
+ * the lock otherwise. The totals are logged at most every
+ * POOL_REPORT_INTERVAL seconds as they are updated, and once at exit.
+ */
+
+// Most free objects one thread cache holds, and how many move per lock
+#define POOL_CACHE_MAX 32
+#define POOL_CACHE_BATCH 16
+
+// Allocations a cache counts before adding them to the pool totals
+#define POOL_COUNT_BATCH 256
+
+// Seconds between two logs of a pool's totals
+#define POOL_REPORT_INTERVAL 60
+
+// Free objects are chained through their first bytes
+struct pool_obj
+{
+    struct pool_obj *next;
+};
+
+struct pool_cache
+{
+    struct mem_pool *pool;
+    struct pool_obj *free_list;
+    int count;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+struct mem_pool client_pool;
+struct mem_pool buffer_pool;
+
+static time_t pool_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// Add the cache's counters to the pool totals and release pool->lock,
+// logging the totals afterwards when a report is due (next_report 0: never)
+static void pool_unlock_collect(struct mem_pool *pool, struct pool_cache *cache)
+{
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    time_t now = pool_now();
+
+    pool->hits += cache->hits;
+    pool->misses += cache->misses;
+    cache->hits = 0;
+    cache->misses = 0;
+
+    if (pool->next_report && now >= pool->next_report)
+    {
+        pool->next_report = now + POOL_REPORT_INTERVAL;
+        hits = pool->hits;
+        misses = pool->misses;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (hits || misses)
+    {
+        syslog(LOG_INFO, "%s pool: %lu hits, %lu misses", pool->name, hits, misses);
+    }
+}
+
+// Caller holds pool->lock; frees what the shared list has no room for
+static void pool_put(struct mem_pool *pool, struct pool_obj *obj)
+{
+    if (pool->free_count >= pool->max_free)
+    {
+        free(obj);
+        return;
+    }
+    obj->next = pool->free_list;
+    pool->free_list = obj;
+    pool->free_count++;
+}
+
+// Move up to n objects from the cache back to the pool
+static void pool_spill(struct mem_pool *pool, struct pool_cache *cache, int n)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (n-- > 0 && cache->free_list)
+    {
+        struct pool_obj *obj = cache->free_list;
+
+        cache->free_list = obj->next;
+        cache->count--;
+        pool_put(pool, obj);
+    }
+    pool_unlock_collect(pool, cache);
+}
+
+static void pool_refill(struct mem_pool *pool, struct pool_cache *cache)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (cache->count < POOL_CACHE_BATCH && pool->free_list)
+    {
+        struct pool_obj *obj = pool->free_list;
+
+        pool->free_list = obj->next;
+        pool->free_count--;
+        obj->next = cache->free_list;
+        cache->free_list = obj;
+        cache->count++;
+    }
+    pool_unlock_collect(pool, cache);
+}
+
+// Key destructor: an exiting thread hands its cache back to the pool
+static void pool_cache_release(void *arg)
+{
+    struct pool_cache *cache = arg;
+
+    pool_spill(cache->pool, cache, cache->count);
+    free(cache);
+}
+
+static struct pool_cache *pool_cache_get(struct mem_pool *pool)
+{
+    struct pool_cache *cache = pthread_getspecific(pool->key);
+
+    if (!cache)
+    {
+        cache = calloc(1, sizeof(*cache));
+        if (!cache)
+        {
+            return NULL;
+        }
+        cache->pool = pool;
+        if (pthread_setspecific(pool->key, cache) != 0)
+        {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+int mem_pool_init(struct mem_pool *pool, const char *name, size_t obj_size, size_t max_free)
+{
+    int err;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->obj_size = obj_size < sizeof(struct pool_obj) ? sizeof(struct pool_obj) : obj_size;
+    pool->max_free = max_free;
+    pool->next_report = pool_now() + POOL_REPORT_INTERVAL;
+
+    err = pthread_key_create(&pool->key, pool_cache_release);
+    if (err != 0)
+    {
+        syslog(LOG_ERR, "Failed to create the %s pool: %s", name, strerror(err));
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return 0;
+}
+
+void mem_pool_destroy(struct mem_pool *pool)
+{
+    struct pool_cache *cache = pthread_getspecific(pool->key);
+
+    // The final totals are logged below, not by the release of the last cache
+    pool->next_report = 0;
+
+    // The calling thread's cache; other threads gave theirs back on exit
+    if (cache)
+    {
+        pthread_setspecific(pool->key, NULL);
+        pool_cache_release(cache);
+    }
+
+    if (pool->hits || pool->misses)
+    {
+        syslog(LOG_INFO, "%s pool: %lu hits, %lu misses", pool->name, pool->hits, pool->misses);
+    }
+
+    while (pool->free_list)
+    {
+        struct pool_obj *obj = pool->free_list;
+
+        pool->free_list = obj->next;
+        free(obj);
+    }
+    pool->free_count = 0;
+
+    pthread_key_delete(pool->key);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void *mem_pool_alloc(struct mem_pool *pool)
+{
+    struct pool_cache *cache = pool_cache_get(pool);
+    struct pool_obj *obj;
+
+    if (!cache)
+    {
+        return malloc(pool->obj_size);
+    }
+
+    if (!cache->free_list)
+    {
+        pool_refill(pool, cache);
+    }
+
+    if (cache->hits + cache->misses >= POOL_COUNT_BATCH)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool_unlock_collect(pool, cache);
+    }
+
+    obj = cache->free_list;
+    if (obj)
+    {
+        cache->free_list = obj->next;
+        cache->count--;
+        cache->hits++;
+        return obj;
+    }
+
+    cache->misses++;
+    return malloc(pool->obj_size);
+}
+
+void mem_pool_free(struct mem_pool *pool, void *obj)
+{
+    struct pool_cache *cache;
+    struct pool_obj *o = obj;
+
+    if (!obj)
+    {
+        return;
+    }
+
+    cache = pool_cache_get(pool);
+    if (!cache)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool_put(pool, o);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    o->next = cache->free_list;
+    cache->free_list = o;
+    if (++cache->count > POOL_CACHE_MAX)
+    {
+        pool_spill(pool, cache, POOL_CACHE_BATCH);
+    }
+}
+
+int mem_pools_init(void)
+{
+    // Free lists sized for a burst of connections; the rest goes back to malloc()
+    if (mem_pool_init(&client_pool, "client", sizeof(thread_data_t), 1024) == -1)
+    {
+        return -1;
+    }
+    if (mem_pool_init(&buffer_pool, "buffer", BUFFER_SIZE, 256) == -1)
+    {
+        mem_pool_destroy(&client_pool);
+        return -1;
+    }
+    return 0;
+}
+
+void mem_pools_destroy(void)
+{
+    mem_pool_destroy(&buffer_pool);
+    mem_pool_destroy(&client_pool);
+}
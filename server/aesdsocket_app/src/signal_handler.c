@@ -1,5 +1,5 @@
 #include "../include/signal_handler.h"
-#include "../include/thread_manager.h"
+#include "../include/event_loop.h"
 #include <errno.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -7,34 +7,43 @@
 #include <syslog.h>
 #include <unistd.h>
 
+/**
+ * Only asks the engines to stop: the accept loop, the workers and every
+ * reactor may still be running, so all teardown is left to main() once they
+ * are joined
+ */
 static void signal_handler(int signo)
 {
+    int saved_errno = errno;
+
     (void)signo; // Unused parameter
-    syslog(LOG_INFO, "Caught signal, exiting");
+
+    // Async-signal-safe calls only: main() logs the exit once the engines return
     keep_running = 0;
-    cleanup_on_signal();
+    event_loop_stop();
+
+    // Wakes the accept loop, whichever thread took the signal
+    shutdown(server_socket, SHUT_RDWR);
+
+    errno = saved_errno;
 }
 
-void cleanup_on_signal(void)
+void cleanup_server(void)
 {
-#if !USE_AESD_CHAR_DEVICE
-    if (timer_thread)
-    {
-        pthread_cancel(timer_thread);
-        pthread_join(timer_thread, NULL);
-    }
-#endif
+    sigset_t signals;
+
+    // Every other thread is gone: a late signal must not shut down a descriptor closed here
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
     if (server_socket != -1)
     {
-        shutdown(server_socket, SHUT_RDWR);
         close(server_socket);
     }
 
-    cleanup_thread_list();
-
     pthread_mutex_destroy(&file_mutex);
-    pthread_mutex_destroy(&thread_list_mutex);
 
 #if !USE_AESD_CHAR_DEVICE
     // Only remove the file if we're not using the character device
@@ -60,4 +69,11 @@ void init_signal_handlers(void)
     {
         syslog(LOG_ERR, "Failed to set SIGTERM handler: %s", strerror(errno));
     }
+
+    // A client closing mid-reply must fail write() with EPIPE, not kill the server
+    sig_action.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &sig_action, NULL) == -1)
+    {
+        syslog(LOG_ERR, "Failed to ignore SIGPIPE: %s", strerror(errno));
+    }
 }
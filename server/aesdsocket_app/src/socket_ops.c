@@ -59,6 +59,7 @@ int setup_server_socket(void)
     {
         syslog(LOG_ERR, "setsockopt failed: %s", strerror(errno));
         close(server_socket);
+        server_socket = -1;
         return -1;
     }
 
@@ -71,6 +72,7 @@ int setup_server_socket(void)
     {
         syslog(LOG_ERR, "Bind failed: %s", strerror(errno));
         close(server_socket);
+        server_socket = -1;
         return -1;
     }
 
@@ -78,6 +80,7 @@ int setup_server_socket(void)
     {
         syslog(LOG_ERR, "Listen failed: %s", strerror(errno));
         close(server_socket);
+        server_socket = -1;
         return -1;
     }
 
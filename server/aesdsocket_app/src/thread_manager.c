@@ -1,271 +1,205 @@
 #include "../include/thread_manager.h"
-#include "../../../aesd-char-driver/aesd_ioctl.h"
+#include "../include/data_file.h"
+#include "../include/line_framer.h"
+#include "../include/mem_pool.h"
 #include "../include/socket_ops.h"
 #include <errno.h>
-#include <fcntl.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
-void *handle_client(void *arg)
+/**
+ * Send the stored data to the client, everything or from a command index
+ * and offset, through a data_reply
+ *
+ * Called with file_mutex held, which is released once the reply is fixed
+ * by data_reply_begin(): the client may take any time to read it, and
+ * other clients keep writing meanwhile.
+ *
+ * Returns 0 on success, -1 on error (logged).
+ */
+static int send_reply(int client_socket, const struct aesd_seekto *seekto)
 {
-    thread_data_t *data = (thread_data_t *)arg;
-    char *buffer = NULL;
-    size_t buffer_size = BUFFER_SIZE;
-    ssize_t bytes_received = 0;
-    thread_node_t *my_node = NULL;
-    int file_desc = -1;
-
-    pthread_t self = pthread_self();
-    my_node = add_thread_to_list(self);
-
-    syslog(LOG_INFO, "Accepted connection from %s", data->client_ip);
+    struct data_reply reply;
+    ssize_t bytes_sent;
+    int result = 0;
 
-    buffer = malloc(buffer_size);
-    if (!buffer)
+    result = data_reply_begin(&reply, seekto);
+    pthread_mutex_unlock(&file_mutex);
+    if (result == -1)
     {
-        syslog(LOG_ERR, "Failed to allocate buffer");
-        goto cleanup;
+        return -1;
     }
 
-    // Main client communication loop - receive data from socket
-    while ((bytes_received = recv(data->client_socket, buffer, buffer_size - 1, 0)) > 0)
+    // Blocking socket: each call sends something until the reply ends
+    while ((bytes_sent = data_reply_send(&reply, client_socket)) > 0)
     {
-        buffer[bytes_received] = '\0'; // Null terminate for string operations
-
-        /**
-         * Check if this is an AESDCHAR_IOCSEEKTO command
-         * Format: "AESDCHAR_IOCSEEKTO:X,Y" where X=command_index, Y=offset
-         * This command should NOT be written to the driver, but instead
-         * triggers an ioctl call followed by a read operation
-         */
-        if (strncmp(buffer, "AESDCHAR_IOCSEEKTO:", 19) == 0)
-        {
-            struct aesd_seekto seekto;
-            char *command_str = buffer + 19; // Skip "AESDCHAR_IOCSEEKTO:" prefix
-
-            /**
-             * Parse X,Y from the command string
-             * X = write_cmd (command index, 0-based)
-             * Y = write_cmd_offset (byte offset within that command)
-             */
-            if (sscanf(command_str, "%u,%u", &seekto.write_cmd, &seekto.write_cmd_offset) != 2)
-            {
-                syslog(LOG_ERR, "Invalid AESDCHAR_IOCSEEKTO format, expected X,Y");
-                break;
-            }
+    }
+    if (bytes_sent < 0)
+    {
+        result = -1;
+    }
 
-            // Acquire mutex lock for thread-safe file operations
-            if (pthread_mutex_lock(&file_mutex) != 0)
-            {
-                syslog(LOG_ERR, "Failed to acquire mutex");
-                break;
-            }
+    data_reply_end(&reply);
+    return result;
+}
 
+/**
+ * Handle one command line from the client
+ *
+ * complete is 0 for a part of a line longer than MAX_LINE_SIZE, and for a
+ * last line the client ended without a newline: data is then stored but
+ * not answered, even when it reads as a seek command. continued marks a
+ * line whose start was already stored.
+ *
+ * Returns 1 after answering a data line, 0 otherwise, -1 to drop the client.
+ */
+static int handle_line(int client_socket, const char *line, size_t len, int continued, int complete)
+{
+    struct aesd_seekto seekto;
+    // Only a whole, newline-terminated line can be a seek command
+    int seek = continued || !complete ? 0 : line_parse_seekto(line, len, &seekto);
+
+    /**
+     * Check if this is an AESDCHAR_IOCSEEKTO command
+     * Format: "AESDCHAR_IOCSEEKTO:X,Y" where X=command_index, Y=offset
+     * This command should NOT be written to the driver, but instead
+     * triggers an ioctl call followed by a read operation
+     */
+    if (seek == -1)
+    {
+        syslog(LOG_ERR, "Invalid AESDCHAR_IOCSEEKTO format, expected X,Y");
+        return -1;
+    }
+    if (seek == 1)
+    {
 #if USE_AESD_CHAR_DEVICE
-            // Open the character device for ioctl and read operations
-            file_desc = open(FILE_PATH, O_RDWR);
-            if (file_desc == -1)
-            {
-                syslog(LOG_ERR, "Failed to open file: %s", strerror(errno));
-                pthread_mutex_unlock(&file_mutex);
-                break;
-            }
-
-            /**
-             * Call ioctl to seek to the specified position
-             * This positions the file pointer to the exact location specified
-             * by the command index and offset within that command
-             */
-            if (ioctl(file_desc, AESDCHAR_IOCSEEKTO, &seekto) == -1)
-            {
-                syslog(LOG_ERR, "IOCTL error: %s", strerror(errno));
-                close(file_desc);
-                pthread_mutex_unlock(&file_mutex);
-                break;
-            }
-
-            /**
-             * Read from the current position (set by ioctl) and send back over socket
-             * This reads all remaining data from the seek position to end of buffer
-             */
-            while ((bytes_received = read(file_desc, buffer, buffer_size - 1)) > 0)
-            {
-                if (write_all(data->client_socket, buffer, bytes_received) != bytes_received)
-                {
-                    syslog(LOG_ERR, "Send error: %s", strerror(errno));
-                    break;
-                }
-            }
-
-            close(file_desc);
-#endif
-            pthread_mutex_unlock(&file_mutex);
-            continue; // Don't process this as a regular write - ioctl handling complete
-        }
-
-        /**
-         * Regular write processing for non-ioctl commands
-         * This handles normal data writes to the character device or file
-         */
+        // Acquire mutex lock for thread-safe file operations
         if (pthread_mutex_lock(&file_mutex) != 0)
         {
             syslog(LOG_ERR, "Failed to acquire mutex");
-            break;
+            return -1;
         }
 
-#if USE_AESD_CHAR_DEVICE
-        // For char driver, directly write to device - it handles the buffer internally
-        file_desc = open(FILE_PATH, O_RDWR);
-#else
-        // For regular file, open with create and append flags
-        file_desc = open(FILE_PATH, O_RDWR | O_CREAT | O_APPEND, FILE_PERMISSIONS);
-#endif
-        if (file_desc == -1)
+        // Send everything from the requested position back over the socket; releases the mutex
+        if (send_reply(client_socket, &seekto) == -1)
         {
-            syslog(LOG_ERR, "Failed to open file: %s", strerror(errno));
-            pthread_mutex_unlock(&file_mutex);
-            break;
+            return -1;
         }
-
-        // Write received data to the device/file
-        if (write_all(file_desc, buffer, bytes_received) != bytes_received)
-        {
-            syslog(LOG_ERR, "Write error: %s", strerror(errno));
-            close(file_desc);
-            pthread_mutex_unlock(&file_mutex);
-            break;
-        }
-
-        /**
-         * Check if we received a complete command (terminated with newline)
-         * If so, read back all accumulated data and send to client
-         */
-        if (memchr(buffer, '\n', bytes_received))
-        {
-#if USE_AESD_CHAR_DEVICE
-            // For character device, close and reopen to reset position for reading
-            close(file_desc);
-            file_desc = open(FILE_PATH, O_RDONLY);
-            if (file_desc == -1)
-            {
-                syslog(LOG_ERR, "Failed to reopen file for reading: %s", strerror(errno));
-                pthread_mutex_unlock(&file_mutex);
-                break;
-            }
-#else
-            // Only need to seek for regular file, not for char device
-            // Character device maintains its own position automatically
-            if (lseek(file_desc, 0, SEEK_SET) == -1)
-            {
-                syslog(LOG_ERR, "Seek error: %s", strerror(errno));
-                close(file_desc);
-                pthread_mutex_unlock(&file_mutex);
-                break;
-            }
 #endif
-            // Read back all accumulated data and send to client
-            // Reset buffer for reading
-            while ((bytes_received = read(file_desc, buffer, buffer_size - 1)) > 0)
-            {
-                if (write_all(data->client_socket, buffer, bytes_received) != bytes_received)
-                {
-                    syslog(LOG_ERR, "Send error: %s", strerror(errno));
-                    break;
-                }
-            }
+        return 0; // Don't process this as a regular write - ioctl handling complete
+    }
 
-            close(file_desc);
-            pthread_mutex_unlock(&file_mutex);
-            break; // Exit the main receive loop after processing complete message
-        }
+    /**
+     * Regular write processing for non-ioctl commands
+     * The whole line goes out in one write, so lines from other clients
+     * never end up inside it
+     */
+    if (pthread_mutex_lock(&file_mutex) != 0)
+    {
+        syslog(LOG_ERR, "Failed to acquire mutex");
+        return -1;
+    }
 
-        close(file_desc);
+    if (data_file_append(line, len) != (ssize_t)len)
+    {
+        syslog(LOG_ERR, "Write error: %s", strerror(errno));
         pthread_mutex_unlock(&file_mutex);
+        return -1;
     }
 
-cleanup:
-    free(buffer);
-    close(data->client_socket);
-    syslog(LOG_INFO, "Closed connection from %s", data->client_ip);
-    free(data);
-
-    if (my_node)
+    if (!complete)
     {
-        pthread_mutex_lock(&thread_list_mutex);
-        my_node->completed = 1;
-        pthread_mutex_unlock(&thread_list_mutex);
+        pthread_mutex_unlock(&file_mutex);
+        return 0;
     }
 
-    return NULL;
-}
-
-thread_node_t *add_thread_to_list(pthread_t thread)
-{
-    thread_node_t *node = malloc(sizeof(thread_node_t));
-    if (!node)
+    // A complete command: read back all accumulated data and send to client
+    if (send_reply(client_socket, NULL) == -1) // Releases the mutex
     {
-        return NULL;
+        return -1;
     }
-
-    node->thread = thread;
-    node->completed = 0;
-
-    pthread_mutex_lock(&thread_list_mutex);
-    node->next = thread_list_head;
-    thread_list_head = node;
-    pthread_mutex_unlock(&thread_list_mutex);
-
-    return node;
+    return 1;
 }
 
-void remove_completed_threads(void)
+void *handle_client(void *arg)
 {
-    pthread_mutex_lock(&thread_list_mutex);
-    thread_node_t *current = thread_list_head;
-    thread_node_t *prev = NULL;
+    thread_data_t *data = (thread_data_t *)arg;
+    struct line_framer framer;
+    int close_after_reply = 0;
+
+    syslog(LOG_INFO, "Accepted connection from %s", data->client_ip);
+
+    if (line_framer_init(&framer) == -1)
+    {
+        goto cleanup;
+    }
 
-    while (current)
+    // Main client communication loop - receive data from socket
+    while (!close_after_reply)
     {
-        if (current->completed)
+        const char *line;
+        size_t len;
+        size_t avail;
+        int continued;
+        int ret = 0;
+        char *space = line_framer_space(&framer, &avail);
+        ssize_t bytes_received;
+
+        if (!space)
         {
-            thread_node_t *to_free = current;
-            if (prev)
+            break;
+        }
+
+        bytes_received = recv(data->client_socket, space, avail, 0);
+        if (bytes_received <= 0)
+        {
+            // Client done sending: a last line without newline still counts
+            if (bytes_received == 0 && line_framer_pending(&framer))
             {
-                prev->next = current->next;
+                line = line_framer_flush(&framer, &len, &continued);
+                handle_line(data->client_socket, line, len, continued, 0);
             }
-            else
+            break;
+        }
+        line_framer_commit(&framer, bytes_received);
+
+        /**
+         * Every complete line is a command of its own. Once a data line
+         * has been answered, the connection ends after the lines already
+         * received
+         */
+        while (ret != -1 && line_framer_next(&framer, &line, &len, &continued))
+        {
+            ret = handle_line(data->client_socket, line, len, continued, 1);
+            if (ret == 1)
             {
-                thread_list_head = current->next;
+                close_after_reply = 1;
             }
-            current = current->next;
-            pthread_join(to_free->thread, NULL);
-            free(to_free);
         }
-        else
+
+        // Store an overlong line in parts rather than buffering it all
+        if (ret != -1 && line_framer_pending(&framer) >= MAX_LINE_SIZE)
+        {
+            line = line_framer_flush(&framer, &len, &continued);
+            ret = handle_line(data->client_socket, line, len, continued, 0);
+        }
+        if (ret == -1)
         {
-            prev = current;
-            current = current->next;
+            break;
         }
     }
-    pthread_mutex_unlock(&thread_list_mutex);
-}
 
-void cleanup_thread_list(void)
-{
-    pthread_mutex_lock(&thread_list_mutex);
-    while (thread_list_head)
-    {
-        thread_node_t *temp = thread_list_head;
-        thread_list_head = thread_list_head->next;
-        pthread_join(temp->thread, NULL);
-        free(temp);
-    }
-    pthread_mutex_unlock(&thread_list_mutex);
+    line_framer_free(&framer);
+
+cleanup:
+    close(data->client_socket);
+    syslog(LOG_INFO, "Closed connection from %s", data->client_ip);
+    mem_pool_free(&client_pool, data);
+
+    return NULL;
 }
 
 #if !USE_AESD_CHAR_DEVICE
@@ -273,7 +207,6 @@ void *timestamp_thread(void *arg)
 {
     char timestamp[100];
     struct timespec sleep_time = {TIMESTAMP_INTERVAL, 0};
-    int file_desc = -1;
 
     while (keep_running)
     {
@@ -284,14 +217,12 @@ void *timestamp_thread(void *arg)
         timeinfo = localtime(&now);
         strftime(timestamp, sizeof(timestamp), "timestamp: %a, %d %b %Y %H:%M:%S %z\n", timeinfo);
 
+        // Cancelled only while sleeping, never holding file_mutex mid-append
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
         pthread_mutex_lock(&file_mutex);
-        file_desc = open(FILE_PATH, O_RDWR | O_APPEND | O_CREAT, FILE_PERMISSIONS);
-        if (file_desc != -1)
-        {
-            write_all(file_desc, timestamp, strlen(timestamp));
-            close(file_desc);
-        }
+        data_file_append(timestamp, strlen(timestamp));
         pthread_mutex_unlock(&file_mutex);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
         nanosleep(&sleep_time, NULL);
     }
@@ -299,4 +230,14 @@ void *timestamp_thread(void *arg)
         return NULL;
     }
 }
+
+void timestamp_thread_stop(void)
+{
+    if (timer_thread)
+    {
+        pthread_cancel(timer_thread);
+        pthread_join(timer_thread, NULL);
+        timer_thread = 0;
+    }
+}
 #endif
@@ -0,0 +1,193 @@
+#include "../include/worker_pool.h"
+#include "../include/mem_pool.h"
+#include "../include/thread_manager.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Fixed set of worker threads taking accepted clients from a bounded ring
+ * buffer, so a connection burst never starts more than nworkers threads.
+ *
+ * When the queue is full, worker_pool_submit() either waits for a free
+ * slot, which stops the accept loop and leaves further clients in the
+ * listen backlog, or rejects the client so the caller closes it at once.
+ */
+
+struct worker
+{
+    pthread_t thread;
+
+    // Socket being served, -1 when idle; lets worker_pool_stop() end it
+    int client_socket;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    thread_data_t **queue;
+    int depth;
+    int head;
+    int count;
+    int reject_when_full;
+    int stopping;
+
+    struct worker *workers;
+    int nworkers;
+
+    unsigned long rejected;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static void *worker_run(void *arg)
+{
+    struct worker *self = arg;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        thread_data_t *data;
+
+        while (!pool.count && !pool.stopping)
+        {
+            pthread_cond_wait(&pool.not_empty, &pool.lock);
+        }
+        if (pool.stopping)
+        {
+            break;
+        }
+
+        data = pool.queue[pool.head];
+        pool.head = (pool.head + 1) % pool.depth;
+        pool.count--;
+        self->client_socket = data->client_socket;
+        pthread_cond_signal(&pool.not_full);
+        pthread_mutex_unlock(&pool.lock);
+
+        // Closes the socket and frees data
+        handle_client(data);
+
+        pthread_mutex_lock(&pool.lock);
+        self->client_socket = -1;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+int worker_pool_start(int nworkers, int queue_depth, int reject_when_full)
+{
+    int i;
+
+    pool.queue = calloc(queue_depth, sizeof(*pool.queue));
+    pool.workers = calloc(nworkers, sizeof(*pool.workers));
+    if (!pool.queue || !pool.workers)
+    {
+        syslog(LOG_ERR, "Failed to allocate the worker pool");
+        free(pool.queue);
+        free(pool.workers);
+        return -1;
+    }
+
+    pool.depth = queue_depth;
+    pool.reject_when_full = reject_when_full;
+    for (i = 0; i < nworkers; i++)
+    {
+        pool.workers[i].client_socket = -1;
+        if (pthread_create(&pool.workers[i].thread, NULL, worker_run, &pool.workers[i]) != 0)
+        {
+            syslog(LOG_ERR, "Failed to create worker thread");
+            worker_pool_stop();
+            return -1;
+        }
+        pool.nworkers++;
+    }
+    return 0;
+}
+
+int worker_pool_submit(thread_data_t *data)
+{
+    int result = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.count == pool.depth && !pool.reject_when_full && keep_running)
+    {
+        // Timed so a signal, which cannot signal the condition, still ends the wait
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&pool.not_full, &pool.lock, &deadline);
+    }
+
+    if (pool.count == pool.depth || pool.stopping)
+    {
+        pool.rejected++;
+        result = -1;
+    }
+    else
+    {
+        pool.queue[(pool.head + pool.count) % pool.depth] = data;
+        pool.count++;
+        pthread_cond_signal(&pool.not_empty);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return result;
+}
+
+void worker_pool_stop(void)
+{
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+
+    // Clients still queued were never served
+    while (pool.count)
+    {
+        thread_data_t *data = pool.queue[pool.head];
+
+        close(data->client_socket);
+        mem_pool_free(&client_pool, data);
+        pool.head = (pool.head + 1) % pool.depth;
+        pool.count--;
+    }
+
+    // Active clients: make their next recv() return 0 so handle_client() ends
+    for (i = 0; i < pool.nworkers; i++)
+    {
+        if (pool.workers[i].client_socket != -1)
+        {
+            shutdown(pool.workers[i].client_socket, SHUT_RDWR);
+        }
+    }
+
+    pthread_cond_broadcast(&pool.not_empty);
+    pthread_cond_broadcast(&pool.not_full);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < pool.nworkers; i++)
+    {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+
+    if (pool.rejected)
+    {
+        syslog(LOG_INFO, "Worker pool rejected %lu connections", pool.rejected);
+    }
+
+    free(pool.queue);
+    free(pool.workers);
+    pool.queue = NULL;
+    pool.workers = NULL;
+    pool.nworkers = 0;
+}
@@ -5,11 +5,18 @@
  * This program tests the newly implemented llseek and ioctl features of the
  * AESD character driver. It verifies:
  * - Writing commands to the driver
- * - llseek operations (SEEK_SET, SEEK_END)
+ * - llseek operations (SEEK_SET, SEEK_END, SEEK_HOLE)
  * - IOCTL AESDCHAR_IOCSEEKTO command with valid parameters
  * - Error handling for invalid IOCTL parameters
+ * - IOCTL AESDCHAR_IOCGETINFO buffer metadata query
+ * - IOCTL AESDCHAR_IOCSNAPSHOT bulk copy of all commands
+ * - IOCTL AESDCHAR_IOCPREAD positioned read
+ * - IOCTL AESDCHAR_IOCSEEKTIME seek by completion time
+ * - IOCTL AESDCHAR_IOCCONSUMER consumer registration
+ * - IOCTL AESDCHAR_IOCRESIZE live capacity change
  */
 
+#define _GNU_SOURCE /* SEEK_DATA and SEEK_HOLE */
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -128,6 +135,154 @@ int main()
         printf("Expected error for invalid command: %s\n", strerror(errno));
     }
 
+    /**
+     * Test 6: Test IOCTL AESDCHAR_IOCGETINFO
+     * Should report the commands written above with their lengths
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCGETINFO...\n");
+    uint32_t lengths[16];
+    struct aesd_info info = {.lengths_len = 16, .lengths_ptr = (uintptr_t)lengths};
+
+    if (ioctl(fd, AESDCHAR_IOCGETINFO, &info) < 0)
+    {
+        perror("IOCTL GETINFO failed");
+    }
+    else
+    {
+        printf("Entries: %u/%u, total bytes: %llu, sequence %llu..%llu\n", info.entry_count, info.capacity,
+               (unsigned long long)info.total_bytes, (unsigned long long)info.oldest_seq,
+               (unsigned long long)info.newest_seq);
+        for (uint32_t i = 0; i < info.lengths_filled; i++)
+        {
+            printf("  command %u: %u bytes\n", i, lengths[i]);
+        }
+    }
+
+    /**
+     * Test 7: Test IOCTL AESDCHAR_IOCSNAPSHOT
+     * Copies every command in one call and prints them using the boundaries
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCSNAPSHOT...\n");
+    struct aesd_snapshot snap = {.buf_ptr = (uintptr_t)buffer,
+                                 .buf_len = sizeof(buffer),
+                                 .lengths_ptr = (uintptr_t)lengths,
+                                 .lengths_len = 16};
+
+    if (ioctl(fd, AESDCHAR_IOCSNAPSHOT, &snap) < 0)
+    {
+        perror("IOCTL SNAPSHOT failed");
+    }
+    else
+    {
+        size_t offset = 0;
+
+        printf("Copied %u commands, %llu of %llu bytes\n", snap.cmd_count, (unsigned long long)snap.bytes_copied,
+               (unsigned long long)snap.bytes_needed);
+        for (uint32_t i = 0; i < snap.cmd_count; i++)
+        {
+            printf("  #%llu: %.*s", (unsigned long long)(snap.first_seq + i), (int)lengths[i], buffer + offset);
+            offset += lengths[i];
+        }
+    }
+
+    /**
+     * Test 8: Test IOCTL AESDCHAR_IOCPREAD
+     * Reads from command 1, offset 5 without moving the file position
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCPREAD from command 1, offset 5...\n");
+    off_t before = lseek(fd, 0, SEEK_CUR);
+    struct aesd_pread pr = {.write_cmd = 1,
+                            .write_cmd_offset = 5,
+                            .buf_ptr = (uintptr_t)buffer,
+                            .buf_len = sizeof(buffer) - 1};
+
+    if (ioctl(fd, AESDCHAR_IOCPREAD, &pr) < 0)
+    {
+        perror("IOCTL PREAD failed");
+    }
+    else
+    {
+        buffer[pr.bytes_copied] = '\0';
+        printf("Read %llu of %llu bytes: '%s'\n", (unsigned long long)pr.bytes_copied,
+               (unsigned long long)pr.bytes_available, buffer);
+        printf("File position %s\n", lseek(fd, 0, SEEK_CUR) == before ? "unchanged" : "CHANGED");
+    }
+
+    /**
+     * Test 9: Test IOCTL AESDCHAR_IOCSEEKTIME
+     * Seeking to time 0 must land on the oldest command at position 0
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCSEEKTIME to time 0...\n");
+    struct aesd_seektime st = {.time_ns = 0};
+
+    if (ioctl(fd, AESDCHAR_IOCSEEKTIME, &st) < 0)
+    {
+        perror("IOCTL SEEKTIME failed");
+    }
+    else
+    {
+        printf("Command %u written at %llu ns, position %llu\n", st.write_cmd,
+               (unsigned long long)st.entry_time_ns, (unsigned long long)st.pos);
+    }
+
+    /**
+     * Test 10: Test IOCTL AESDCHAR_IOCCONSUMER
+     * Register as a consumer, read one command, then unregister
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCCONSUMER...\n");
+    uint32_t consumer = 1;
+
+    if (ioctl(fd, AESDCHAR_IOCCONSUMER, &consumer) < 0)
+    {
+        perror("IOCTL CONSUMER register failed");
+    }
+    else
+    {
+        bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+        if (bytes_read > 0)
+        {
+            buffer[bytes_read] = '\0';
+            printf("Consumer read: %s", buffer);
+        }
+
+        consumer = 0;
+        if (ioctl(fd, AESDCHAR_IOCCONSUMER, &consumer) < 0)
+        {
+            perror("IOCTL CONSUMER unregister failed");
+        }
+    }
+
+    /**
+     * Test 11: Test IOCTL AESDCHAR_IOCRESIZE
+     * Grow the ring to 20 commands, which keeps everything held
+     */
+    printf("\nTesting IOCTL AESDCHAR_IOCRESIZE to 20 commands...\n");
+    uint32_t capacity = 20;
+
+    if (ioctl(fd, AESDCHAR_IOCRESIZE, &capacity) < 0)
+    {
+        perror("IOCTL RESIZE failed");
+    }
+    else
+    {
+        printf("Capacity is now %u commands\n", capacity);
+    }
+
+    /**
+     * Test 12: Test llseek with SEEK_HOLE
+     * Step from one command boundary to the next until the end of the data
+     */
+    printf("\nTesting llseek SEEK_HOLE command boundaries...\n");
+    pos = 0;
+    while ((pos = lseek(fd, pos, SEEK_HOLE)) >= 0)
+    {
+        printf("Command ends at position: %ld\n", pos);
+    }
+    if (errno != ENXIO)
+    {
+        perror("lseek SEEK_HOLE failed");
+    }
+
     close(fd);
     printf("\nTest completed\n");
     return 0;
@@ -12,7 +12,8 @@ echo "Testing AESD Socket with IOCTL support"
 send_to_socket() {
     local data="$1"
     echo "Sending: $data"
-    echo -n "$data" | nc $SERVER_HOST $SERVER_PORT
+    # The server handles one command per newline-terminated line
+    printf '%s\n' "$data" | nc $SERVER_HOST $SERVER_PORT
     echo ""
 }
 